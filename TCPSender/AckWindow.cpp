@@ -0,0 +1,62 @@
+#include "AckWindow.h"
+#include "Frame.h"
+
+void AckWindow::push(char const* frames, size_t len, uint64_t seq)
+{
+	if (frame_lens.empty())
+		first_seq = seq;
+
+	buf.append(frames, len);
+
+	for (size_t pos = 0; pos + 4 <= len; ) {
+		uint32_t frame_len = 4 + get_le32(frames + pos);
+		frame_lens.push_back(frame_len);
+		pos += frame_len;
+	}
+}
+
+size_t AckWindow::ack(uint64_t count)
+{
+	size_t n = 0;
+
+	while (!frame_lens.empty() && first_seq <= count) {
+		head += frame_lens.front();
+		frame_lens.pop_front();
+		++first_seq;
+		++n;
+	}
+
+	// Reclaim released space once it dominates the buffer
+	if (head > buf.size() / 2) {
+		buf.erase(0, head);
+		head = 0;
+	}
+
+	return n;
+}
+
+size_t AckWindow::feed(char const* data, size_t len)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		ack_buf[ack_have++] = data[i];
+		if (ack_have < ACK_LEN)
+			continue;
+
+		n += ack(get_le64(ack_buf));
+		ack_have = 0;
+	}
+
+	return n;
+}
+
+void AckWindow::restart()
+{
+	ack_have = 0;
+}
+
+void AckWindow::renumber(uint64_t seq)
+{
+	first_seq = seq;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// In ack mode the receiver answers with 8 byte little endian cumulative
+// acks: the highest frame number it received without gaps
+#define ACK_LEN 8
+
+/**
+ * Frames sent but not yet acknowledged by the receiver.
+ *
+ * Frames are numbered consecutively in send order. An ack of n releases
+ * every frame up to n. After a reconnect all remaining frames are sent
+ * again. Legacy frames carry no number, there the receiver counts frames
+ * per connection and the window is renumbered from 1 on reconnect.
+ */
+class AckWindow {
+public:
+	/**
+	 * Add complete, length prefixed frames as they are about to be sent.
+	 * seq is the number of the first one and must follow the frames
+	 * already in the window.
+	 */
+	void push(char const* frames, size_t len, uint64_t seq);
+
+	/**
+	 * Release frames up to and including number count.
+	 * Returns the number of frames released.
+	 */
+	size_t ack(uint64_t count);
+
+	/**
+	 * Process bytes read from the receiver. Acks may be split across reads.
+	 * Returns the number of frames released.
+	 */
+	size_t feed(char const* data, size_t len);
+
+	/**
+	 * Prepare for a new connection. The remaining frames have to be sent
+	 * again from data().
+	 */
+	void restart();
+
+	/**
+	 * Number the remaining frames from seq on
+	 */
+	void renumber(uint64_t seq);
+
+	size_t size() const { return frame_lens.size(); }
+	bool empty() const { return frame_lens.empty(); }
+
+	char const* data() const { return buf.data() + head; }
+	size_t bytes() const { return buf.size() - head; }
+
+private:
+	std::string buf;
+	size_t head = 0;
+	std::deque<uint32_t> frame_lens;
+
+	// Connection number of the oldest frame in the window
+	uint64_t first_seq = 1;
+
+	// Partially received ack
+	char ack_buf[ACK_LEN];
+	size_t ack_have = 0;
+};
@@ -0,0 +1,32 @@
+#include "Backoff.h"
+
+#include <algorithm>
+
+Backoff::Backoff() : rng{std::random_device{}()}
+{
+}
+
+void Backoff::configure(unsigned initial_ms, double multiplier, unsigned max_ms,
+	unsigned jitter_pct)
+{
+	this->initial_ms = initial_ms;
+	// Also catches NaN, which would make the delay undefined
+	this->multiplier = !(multiplier >= 1.0) ? 1.0 : multiplier;
+	this->max_ms = std::max(max_ms, initial_ms);
+	this->jitter_pct = std::min(jitter_pct, 100u);
+}
+
+std::chrono::milliseconds Backoff::next_delay()
+{
+	double delay = initial_ms;
+	for (unsigned i = 0; i < n_attempts && delay < max_ms; ++i)
+		delay *= multiplier;
+	delay = std::min(delay, (double) max_ms);
+	++n_attempts;
+
+	double jitter = jitter_pct / 100.0;
+	std::uniform_real_distribution<double> dist{1.0 - jitter, 1.0 + jitter};
+	delay *= dist(rng);
+
+	return std::chrono::milliseconds{(long long) delay};
+}
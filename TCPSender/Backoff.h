@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+
+/**
+ * Reconnect delay schedule: starts at initial_ms and grows by multiplier on
+ * every failure up to max_ms. Each delay is randomized by +-jitter_pct
+ * percent so multiple senders do not retry in lockstep.
+ */
+class Backoff {
+public:
+	Backoff();
+
+	void configure(unsigned initial_ms, double multiplier, unsigned max_ms,
+		unsigned jitter_pct);
+
+	/**
+	 * Delay to wait before the next attempt. Advances the schedule.
+	 */
+	std::chrono::milliseconds next_delay();
+
+	/**
+	 * Start over from the initial delay, e.g. after connecting
+	 */
+	void reset() { n_attempts = 0; }
+
+	/**
+	 * Number of delays handed out since the last reset
+	 */
+	unsigned attempts() const { return n_attempts; }
+
+private:
+	unsigned initial_ms = 250;
+	double multiplier = 2.0;
+	unsigned max_ms = 30000;
+	unsigned jitter_pct = 20;
+
+	unsigned n_attempts = 0;
+	std::minstd_rand rng;
+};
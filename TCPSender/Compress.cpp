@@ -0,0 +1,80 @@
+#include "Compress.h"
+
+#ifdef TCPSENDER_ZSTD
+#include <zstd.h>
+
+StreamCompressor::~StreamCompressor()
+{
+	ZSTD_freeCCtx((ZSTD_CCtx*) ctx);
+}
+
+bool StreamCompressor::available()
+{
+	return true;
+}
+
+bool StreamCompressor::start(int level)
+{
+	running = false;
+
+	if (!ctx)
+		ctx = ZSTD_createCCtx();
+	if (!ctx)
+		return false;
+
+	auto cctx = (ZSTD_CCtx*) ctx;
+	ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+			level)))
+		return false;
+
+	running = true;
+	return true;
+}
+
+bool StreamCompressor::compress(char const* data, size_t len, std::string& out)
+{
+	auto cctx = (ZSTD_CCtx*) ctx;
+	ZSTD_inBuffer in{data, len, 0};
+
+	out.resize(ZSTD_compressBound(len) + 32);
+	size_t have = 0;
+
+	for (;;) {
+		ZSTD_outBuffer o{&out[have], out.size() - have, 0};
+		size_t left = ZSTD_compressStream2(cctx, &o, &in, ZSTD_e_flush);
+		if (ZSTD_isError(left))
+			return false;
+
+		have += o.pos;
+		if (left == 0)
+			break;
+		out.resize(out.size() * 2);
+	}
+
+	out.resize(have);
+	return true;
+}
+
+#else
+
+StreamCompressor::~StreamCompressor()
+{
+}
+
+bool StreamCompressor::available()
+{
+	return false;
+}
+
+bool StreamCompressor::start(int)
+{
+	return false;
+}
+
+bool StreamCompressor::compress(char const*, size_t, std::string&)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * zstd stream for everything sent on one connection.
+ *
+ * The compression context lives as long as the connection, so earlier
+ * sentences act as dictionary for later ones and short repetitive lines
+ * still compress. Each call flushes, the receiver can decode every batch
+ * as soon as it arrives.
+ *
+ * Only functional if built with TCPSENDER_ZSTD, otherwise available()
+ * is false and the receiver is never offered compression.
+ */
+class StreamCompressor {
+public:
+	StreamCompressor() = default;
+	~StreamCompressor();
+
+	StreamCompressor(StreamCompressor const&) = delete;
+	StreamCompressor& operator=(StreamCompressor const&) = delete;
+
+	static bool available();
+
+	/**
+	 * Start a new stream, e.g. for a new connection
+	 */
+	bool start(int level);
+
+	/**
+	 * Stop compressing until the next start
+	 */
+	void stop() { running = false; }
+
+	bool active() const { return running; }
+
+	/**
+	 * Replace out with the compressed and flushed data
+	 */
+	bool compress(char const* data, size_t len, std::string& out);
+
+private:
+	void* ctx = nullptr;
+	bool running = false;
+};
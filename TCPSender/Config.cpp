@@ -0,0 +1,207 @@
+#include "Config.h"
+
+#include <cmath>
+#include <cwchar>
+#include <fstream>
+
+using std::filesystem::path;
+using std::wstring;
+
+#define CONFIG_ENTRY_QUEUE_CAPACITY L"QueueCapacity"
+#define CONFIG_ENTRY_BATCH_MAX_MSGS L"BatchMaxMessages"
+#define CONFIG_ENTRY_BATCH_MAX_BYTES L"BatchMaxBytes"
+#define CONFIG_ENTRY_BATCH_LATENCY L"BatchLatencyMs"
+#define CONFIG_ENTRY_CONNECT_STAGGER L"ConnectStaggerMs"
+#define CONFIG_ENTRY_CONNECT_TIMEOUT L"ConnectTimeoutMs"
+#define CONFIG_ENTRY_DNS_TTL L"DnsCacheTtlMs"
+#define CONFIG_ENTRY_RECONNECT_INITIAL L"ReconnectInitialMs"
+#define CONFIG_ENTRY_RECONNECT_MULTIPLIER L"ReconnectMultiplier"
+#define CONFIG_ENTRY_RECONNECT_MAX L"ReconnectMaxMs"
+#define CONFIG_ENTRY_RECONNECT_JITTER L"ReconnectJitterPct"
+#define CONFIG_ENTRY_SPILL_FILE L"SpillFile"
+#define CONFIG_ENTRY_SPILL_MAX_BYTES L"SpillMaxBytes"
+#define CONFIG_ENTRY_ACK_MODE L"AckMode"
+#define CONFIG_ENTRY_ACK_WINDOW L"AckWindow"
+#define CONFIG_ENTRY_FRAME_VERSION L"FrameVersion"
+#define CONFIG_ENTRY_COMPRESSION L"Compression"
+#define CONFIG_ENTRY_COMPRESSION_LEVEL L"CompressionLevel"
+#define CONFIG_ENTRY_FORWARD_ALL L"ForwardAllThreads"
+#define CONFIG_ENTRY_THREAD_ALLOW L"ThreadAllow"
+#define CONFIG_ENTRY_THREAD_DENY L"ThreadDeny"
+#define CONFIG_ENTRY_DEDUP_RECENT L"DedupRecent"
+#define CONFIG_ENTRY_COLLAPSE_REPEATS L"CollapseRepeats"
+#define CONFIG_ENTRY_METRICS_FILE L"MetricsFile"
+#define CONFIG_ENTRY_METRICS_INTERVAL L"MetricsIntervalMs"
+#define CONFIG_ENTRY_LATENCY_TRACE L"LatencyTrace"
+#define CONFIG_ENTRY_LOG_LEVEL L"LogLevel"
+
+std::vector<wstring> split_list(wstring const& list)
+{
+	std::vector<wstring> names;
+	size_t pos = 0;
+
+	while (pos <= list.length()) {
+		size_t end = list.find(L',', pos);
+		if (end == wstring::npos)
+			end = list.length();
+
+		size_t first = list.find_first_not_of(L" \t", pos);
+		if (first < end) {
+			size_t last = list.find_last_not_of(L" \t", end - 1);
+			names.push_back(list.substr(first, last - first + 1));
+		}
+
+		pos = end + 1;
+	}
+
+	return names;
+}
+
+static void parse_uint(wstring const& val, unsigned& out)
+{
+	wchar_t* end;
+	unsigned long v = wcstoul(val.c_str(), &end, 10);
+	if (!val.empty() && *end == L'\0')
+		out = (unsigned) v;
+}
+
+// Rejects nan and inf, which wcstod accepts
+static void parse_double(wstring const& val, double& out)
+{
+	wchar_t* end;
+	double v = wcstod(val.c_str(), &end);
+	if (!val.empty() && *end == L'\0' && std::isfinite(v))
+		out = v;
+}
+
+// Limits of 0 would stall sending
+static void parse_limit(wstring const& val, unsigned& out)
+{
+	parse_uint(val, out);
+	if (out == 0)
+		out = 1;
+}
+
+static void parse_bool(wstring const& val, bool& out)
+{
+	if (val == L"1" || val == L"0")
+		out = val == L"1";
+}
+
+void set_config_entry(Config& cfg, wstring const& key, wstring const& val)
+{
+	if (key == CONFIG_ENTRY_QUEUE_CAPACITY)
+		parse_limit(val, cfg.queue_capacity);
+	else if (key == CONFIG_ENTRY_BATCH_MAX_MSGS)
+		parse_limit(val, cfg.batch_max_msgs);
+	else if (key == CONFIG_ENTRY_BATCH_MAX_BYTES)
+		parse_uint(val, cfg.batch_max_bytes);
+	else if (key == CONFIG_ENTRY_BATCH_LATENCY)
+		parse_uint(val, cfg.batch_latency_ms);
+	else if (key == CONFIG_ENTRY_CONNECT_STAGGER)
+		parse_uint(val, cfg.connect_stagger_ms);
+	else if (key == CONFIG_ENTRY_CONNECT_TIMEOUT)
+		parse_uint(val, cfg.connect_timeout_ms);
+	else if (key == CONFIG_ENTRY_DNS_TTL)
+		parse_uint(val, cfg.dns_ttl_ms);
+	else if (key == CONFIG_ENTRY_RECONNECT_INITIAL)
+		parse_uint(val, cfg.reconnect_initial_ms);
+	else if (key == CONFIG_ENTRY_RECONNECT_MULTIPLIER)
+		parse_double(val, cfg.reconnect_multiplier);
+	else if (key == CONFIG_ENTRY_RECONNECT_MAX)
+		parse_uint(val, cfg.reconnect_max_ms);
+	else if (key == CONFIG_ENTRY_RECONNECT_JITTER)
+		parse_uint(val, cfg.reconnect_jitter_pct);
+	else if (key == CONFIG_ENTRY_SPILL_FILE)
+		cfg.spill_file = val;
+	else if (key == CONFIG_ENTRY_SPILL_MAX_BYTES)
+		parse_uint(val, cfg.spill_max_bytes);
+	else if (key == CONFIG_ENTRY_ACK_MODE)
+		parse_bool(val, cfg.ack_mode);
+	else if (key == CONFIG_ENTRY_ACK_WINDOW)
+		parse_limit(val, cfg.ack_window);
+	else if (key == CONFIG_ENTRY_FRAME_VERSION)
+		parse_uint(val, cfg.frame_version);
+	else if (key == CONFIG_ENTRY_COMPRESSION)
+		parse_bool(val, cfg.compression);
+	else if (key == CONFIG_ENTRY_COMPRESSION_LEVEL)
+		parse_uint(val, cfg.compression_level);
+	else if (key == CONFIG_ENTRY_FORWARD_ALL)
+		parse_bool(val, cfg.forward_all_threads);
+	else if (key == CONFIG_ENTRY_THREAD_ALLOW)
+		cfg.thread_allow = val;
+	else if (key == CONFIG_ENTRY_THREAD_DENY)
+		cfg.thread_deny = val;
+	else if (key == CONFIG_ENTRY_DEDUP_RECENT)
+		parse_uint(val, cfg.dedup_recent);
+	else if (key == CONFIG_ENTRY_COLLAPSE_REPEATS)
+		parse_uint(val, cfg.collapse_repeats);
+	else if (key == CONFIG_ENTRY_METRICS_FILE)
+		cfg.metrics_file = val;
+	else if (key == CONFIG_ENTRY_METRICS_INTERVAL)
+		parse_uint(val, cfg.metrics_interval_ms);
+	else if (key == CONFIG_ENTRY_LATENCY_TRACE)
+		parse_bool(val, cfg.latency_trace);
+	else if (key == CONFIG_ENTRY_LOG_LEVEL)
+		parse_log_level(val, cfg.log_level);
+}
+
+bool load_config(path const& filepath, Config& cfg)
+{
+	std::wifstream f{filepath};
+	if (f.fail())
+		return false;
+
+	std::getline(f, cfg.remote);
+
+	wstring line;
+	if (std::getline(f, line))
+		parse_bool(line, cfg.connect);
+
+	while (std::getline(f, line)) {
+		wstring::size_type pos = line.find(L'=');
+		if (pos != wstring::npos)
+			set_config_entry(cfg, line.substr(0, pos), line.substr(pos + 1));
+	}
+
+	return true;
+}
+
+bool save_config(path const& filepath, Config const& cfg)
+{
+	std::wofstream f{filepath, std::ios_base::trunc};
+	if (!f.good())
+		return false;
+
+	f << cfg.remote.c_str() << "\n";
+	f << cfg.connect << "\n";
+	f << CONFIG_ENTRY_QUEUE_CAPACITY << "=" << cfg.queue_capacity << "\n";
+	f << CONFIG_ENTRY_BATCH_MAX_MSGS << "=" << cfg.batch_max_msgs << "\n";
+	f << CONFIG_ENTRY_BATCH_MAX_BYTES << "=" << cfg.batch_max_bytes << "\n";
+	f << CONFIG_ENTRY_BATCH_LATENCY << "=" << cfg.batch_latency_ms << "\n";
+	f << CONFIG_ENTRY_CONNECT_STAGGER << "=" << cfg.connect_stagger_ms << "\n";
+	f << CONFIG_ENTRY_CONNECT_TIMEOUT << "=" << cfg.connect_timeout_ms << "\n";
+	f << CONFIG_ENTRY_DNS_TTL << "=" << cfg.dns_ttl_ms << "\n";
+	f << CONFIG_ENTRY_RECONNECT_INITIAL << "=" << cfg.reconnect_initial_ms << "\n";
+	f << CONFIG_ENTRY_RECONNECT_MULTIPLIER << "=" << cfg.reconnect_multiplier << "\n";
+	f << CONFIG_ENTRY_RECONNECT_MAX << "=" << cfg.reconnect_max_ms << "\n";
+	f << CONFIG_ENTRY_RECONNECT_JITTER << "=" << cfg.reconnect_jitter_pct << "\n";
+	f << CONFIG_ENTRY_SPILL_FILE << "=" << cfg.spill_file.c_str() << "\n";
+	f << CONFIG_ENTRY_SPILL_MAX_BYTES << "=" << cfg.spill_max_bytes << "\n";
+	f << CONFIG_ENTRY_ACK_MODE << "=" << cfg.ack_mode << "\n";
+	f << CONFIG_ENTRY_ACK_WINDOW << "=" << cfg.ack_window << "\n";
+	f << CONFIG_ENTRY_FRAME_VERSION << "=" << cfg.frame_version << "\n";
+	f << CONFIG_ENTRY_COMPRESSION << "=" << cfg.compression << "\n";
+	f << CONFIG_ENTRY_COMPRESSION_LEVEL << "=" << cfg.compression_level << "\n";
+	f << CONFIG_ENTRY_FORWARD_ALL << "=" << cfg.forward_all_threads << "\n";
+	f << CONFIG_ENTRY_THREAD_ALLOW << "=" << cfg.thread_allow << "\n";
+	f << CONFIG_ENTRY_THREAD_DENY << "=" << cfg.thread_deny << "\n";
+	f << CONFIG_ENTRY_DEDUP_RECENT << "=" << cfg.dedup_recent << "\n";
+	f << CONFIG_ENTRY_COLLAPSE_REPEATS << "=" << cfg.collapse_repeats << "\n";
+	f << CONFIG_ENTRY_METRICS_FILE << "=" << cfg.metrics_file << "\n";
+	f << CONFIG_ENTRY_METRICS_INTERVAL << "=" << cfg.metrics_interval_ms << "\n";
+	f << CONFIG_ENTRY_LATENCY_TRACE << "=" << cfg.latency_trace << "\n";
+	f << CONFIG_ENTRY_LOG_LEVEL << "=" << log_level_name(cfg.log_level) << "\n";
+
+	return f.good();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Log.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Persistent settings. The file starts with the remote and the connect flag
+ * on their own lines, optionally followed by Key=Value lines.
+ */
+struct Config {
+	// One or more receivers, separated by commas
+	std::wstring remote = L"localhost:30501";
+	bool connect = false;
+
+	// Sentences queued per receiver and lane before the oldest are dropped,
+	// at most MSG_Q_CAP
+	unsigned queue_capacity = 16;
+
+	// Frame batching: limits per write and how long to wait for more frames
+	unsigned batch_max_msgs = 64;
+	unsigned batch_max_bytes = 64 * 1024;
+	unsigned batch_latency_ms = 0;
+
+	// Time between starting parallel connection attempts and until each
+	// attempt is abandoned
+	unsigned connect_stagger_ms = 250;
+	unsigned connect_timeout_ms = 2000;
+
+	// How long resolved addresses of the remote are reused, 0 disables
+	unsigned dns_ttl_ms = 60000;
+
+	// Delay between failed connection attempts, see Backoff
+	unsigned reconnect_initial_ms = 250;
+	double reconnect_multiplier = 2.0;
+	unsigned reconnect_max_ms = 30000;
+	unsigned reconnect_jitter_pct = 20;
+
+	// Spill log for sentences queued while the receiver is unreachable,
+	// relative to the config file. Empty disables spilling.
+	std::wstring spill_file;
+	unsigned spill_max_bytes = 16 * 1024 * 1024;
+
+	// Keep frames until the receiver acknowledges them, see AckWindow.
+	// ack_window limits the number of unacknowledged frames.
+	bool ack_mode = false;
+	unsigned ack_window = 256;
+
+	// Frame format, see Frame.h. Version 2 needs a handshake with the
+	// receiver and adds sequence numbers and sentence metadata.
+	unsigned frame_version = 1;
+
+	// zstd compression with frame version 2, if built in and accepted by
+	// the receiver
+	bool compression = false;
+	unsigned compression_level = 3;
+
+	// Forward text threads other than the selected one, see ThreadFilter
+	bool forward_all_threads = false;
+	std::wstring thread_allow;
+	std::wstring thread_deny = L"Console";
+
+	// Suppress repeats among the last dedup_recent sentences and collapse
+	// repeated characters or text by COLLAPSE_ flags, see Dedup
+	unsigned dedup_recent = 0;
+	unsigned collapse_repeats = 0;
+
+	// Plain text dump of the counters, rewritten every metrics_interval_ms
+	// and relative to the config file. Empty disables the dump.
+	std::wstring metrics_file;
+	unsigned metrics_interval_ms = 1000;
+
+	// Record the latency of each pipeline stage, see StageTrace
+	bool latency_trace = false;
+
+	LogLevel log_level = LogLevel::INFO;
+};
+
+/**
+ * Returns false if the file could not be opened. Unknown or malformed
+ * entries are ignored and keep their defaults.
+ */
+bool load_config(std::filesystem::path const& filepath, Config& cfg);
+
+bool save_config(std::filesystem::path const& filepath, Config const& cfg);
+
+/**
+ * Set a single Key=Value entry as found in the config file. Unknown keys
+ * and malformed values are ignored.
+ */
+void set_config_entry(Config& cfg, std::wstring const& key,
+	std::wstring const& val);
+
+/**
+ * Split a comma separated list, trimming spaces and skipping empty items
+ */
+std::vector<std::wstring> split_list(std::wstring const& list);
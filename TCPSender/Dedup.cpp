@@ -0,0 +1,109 @@
+#include "Dedup.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <cwchar>
+
+// Code units gathered on the stack per encoding step when collapsing
+#define COLLAPSE_CHUNK 256
+
+void Dedup::configure(unsigned recent, unsigned collapse)
+{
+	n_recent.store(std::min(recent, (unsigned) DEDUP_MAX_RECENT),
+		std::memory_order_relaxed);
+	this->collapse.store(collapse, std::memory_order_relaxed);
+}
+
+bool Dedup::seen(uint64_t hash)
+{
+	unsigned n = n_recent.load(std::memory_order_relaxed);
+	if (n == 0)
+		return false;
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (hashes[i].load(std::memory_order_relaxed) == hash) {
+			n_hits.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	size_t slot = next.fetch_add(1, std::memory_order_relaxed) % n;
+	hashes[slot].store(hash, std::memory_order_relaxed);
+	return false;
+}
+
+size_t repeat_factor(wchar_t const* s, size_t n)
+{
+	if (n < DEDUP_MIN_REPEAT_LEN)
+		return 1;
+
+	size_t k = 1;
+	while (k < n && s[k] == s[0])
+		++k;
+	if (k == 1 || n % k != 0)
+		return 1;
+
+	// Every run has to be exactly k long, so "ああ、そうか" and doubled
+	// runs ("ここここんん") stay intact
+	for (size_t i = k; i < n; i += k) {
+		if (s[i] == s[i - 1])
+			return 1;
+		for (size_t j = 1; j < k; ++j)
+			if (s[i + j] != s[i])
+				return 1;
+	}
+
+	return k;
+}
+
+size_t repeat_period(wchar_t const* s, size_t n)
+{
+	if (n < DEDUP_MIN_REPEAT_LEN)
+		return n;
+
+	// s has period p if it equals itself shifted by p. Periods of 1 are
+	// skipped, runs of one character are ordinary text ("ああ", "……").
+	for (size_t p = 2; p <= n / 2; ++p)
+		if (n % p == 0 && wmemcmp(s, s + p, n - p) == 0)
+			return p;
+
+	return n;
+}
+
+uint64_t sentence_hash(wchar_t const* s, size_t n, size_t stride,
+	uint32_t text_number)
+{
+	// FNV-1a
+	uint64_t h = 14695981039346656037ull ^ text_number;
+	for (size_t i = 0; i < n; i += stride)
+		h = (h ^ (uint64_t) s[i]) * 1099511628211ull;
+
+	// 0 marks empty slots in Dedup
+	return h != 0 ? h : 1;
+}
+
+size_t collapse_to_utf8(wchar_t const* s, size_t n, size_t stride, char* dst)
+{
+	if (stride <= 1)
+		return utf16_to_utf8(s, n, dst);
+
+	wchar_t chunk[COLLAPSE_CHUNK];
+	size_t have = 0;
+	size_t out = 0;
+
+	for (size_t i = 0; i < n; i += stride) {
+		chunk[have++] = s[i];
+		if (have < COLLAPSE_CHUNK)
+			continue;
+
+		// Keep a trailing high surrogate for its partner in the next chunk
+		size_t keep = sizeof(wchar_t) == 2
+			&& chunk[have - 1] >= 0xd800 && chunk[have - 1] < 0xdc00;
+		out += utf16_to_utf8(chunk, have - keep, dst + out);
+		if (keep)
+			chunk[0] = chunk[have - 1];
+		have = keep;
+	}
+
+	return out + utf16_to_utf8(chunk, have, dst + out);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Upper limit for the number of remembered sentences
+#define DEDUP_MAX_RECENT 64
+
+// Shortest sentence considered for collapsing
+#define DEDUP_MIN_REPEAT_LEN 4
+
+// Config::collapse_repeats flags: every character repeated the same
+// number of times, or the whole text repeated
+#define COLLAPSE_CHARS 0x01
+#define COLLAPSE_TEXT 0x02
+
+/**
+ * Suppresses sentences that were already forwarded recently, e.g. when a
+ * hook fires again on repaint.
+ *
+ * Remembers the hashes of the last few sentences in a fixed ring. Safe to
+ * use from concurrent hook threads without locking; two identical
+ * sentences racing each other may both get through.
+ */
+class Dedup {
+public:
+	/**
+	 * recent of 0 disables suppression. collapse holds COLLAPSE_ flags:
+	 * with COLLAPSE_CHARS sentences where every character is repeated the
+	 * same number of times ("ここんんにに") are forwarded with single
+	 * characters, with COLLAPSE_TEXT sentences that consist of the same
+	 * text repeated ("こんにちはこんにちは") are forwarded once.
+	 */
+	void configure(unsigned recent, unsigned collapse);
+
+	bool enabled() const { return n_recent.load(std::memory_order_relaxed) > 0; }
+	unsigned collapse_flags() const { return collapse.load(std::memory_order_relaxed); }
+
+	/**
+	 * True if hash is among the recent sentences, otherwise remembers it
+	 */
+	bool seen(uint64_t hash);
+
+	// Suppressed duplicates and collapsed sentences
+	uint64_t hits() const { return n_hits.load(std::memory_order_relaxed); }
+	uint64_t collapsed() const { return n_collapsed.load(std::memory_order_relaxed); }
+
+	void count_collapsed() { n_collapsed.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> hashes[DEDUP_MAX_RECENT] = {};
+	std::atomic<unsigned> n_recent{0};
+	std::atomic<unsigned> collapse{0};
+	std::atomic<size_t> next{0};
+
+	std::atomic<uint64_t> n_hits{0};
+	std::atomic<uint64_t> n_collapsed{0};
+};
+
+/**
+ * Length k of the runs if the n code units of s consist of runs of one
+ * character that are all exactly k >= 2 long, 1 if not or if n is below
+ * DEDUP_MIN_REPEAT_LEN. Keeping every k-th code unit collapses the runs.
+ */
+size_t repeat_factor(wchar_t const* s, size_t n);
+
+/**
+ * Length of the shortest text of at least 2 code units that the n code
+ * units of s repeat at least twice, n if there is none or n is below
+ * DEDUP_MIN_REPEAT_LEN
+ */
+size_t repeat_period(wchar_t const* s, size_t n);
+
+/**
+ * Hash of every stride-th of the n code units of s, salted with the text
+ * thread number so identical lines of different threads are told apart
+ */
+uint64_t sentence_hash(wchar_t const* s, size_t n, size_t stride,
+	uint32_t text_number);
+
+/**
+ * Encode every stride-th of the n code units of s to UTF-8 like
+ * utf16_to_utf8. dst must hold utf8_max_len(n / stride) bytes.
+ */
+size_t collapse_to_utf8(wchar_t const* s, size_t n, size_t stride, char* dst);
@@ -1,6 +1,6 @@
 #include "Extension.h"
 
-bool ProcessSentence(std::wstring& sentence, SentenceInfo sentenceInfo);
+void ObserveSentence(const wchar_t* sentence, SentenceInfo sentenceInfo);
 
 /*
 	You shouldn't mess with this or even look at it unless you're certain you know what you're doing.
@@ -17,13 +17,8 @@ extern "C" __declspec(dllexport) wchar_t* OnNewSentence(wchar_t* sentence, const
 {
 	try
 	{
-		std::wstring sentenceCopy(sentence);
-		auto oldSize = sentenceCopy.size();
-		if (ProcessSentence(sentenceCopy, SentenceInfo{ sentenceInfo }))
-		{
-			if (sentenceCopy.size() > oldSize) sentence = (wchar_t*)HeapReAlloc(GetProcessHeap(), HEAP_GENERATE_EXCEPTIONS, sentence, (sentenceCopy.size() + 1) * sizeof(wchar_t));
-			wcscpy_s(sentence, sentenceCopy.size() + 1, sentenceCopy.c_str());
-		}
+		// The sentence is only read, so skip the copy ProcessSentence needs
+		ObserveSentence(sentence, SentenceInfo{ sentenceInfo });
 	}
 	catch (SKIP)
 	{
@@ -0,0 +1,65 @@
+#include "Frame.h"
+
+#include <cstring>
+
+size_t begin_frame(std::string& buf, int version)
+{
+	size_t off = buf.size();
+	buf.append(frame_payload_off(version), '\0');
+	return off;
+}
+
+void end_frame(std::string& buf, size_t off, int version, uint64_t seq,
+	SentenceMeta const& meta)
+{
+	char* p = &buf[off];
+	put_le32(p, (uint32_t) (buf.size() - off - 4));
+
+	if (version < FRAME_VERSION_2)
+		return;
+
+	p[4] = (char) FRAME_VERSION_2;
+	p[5] = (char) FRAME_TYPE_SENTENCE;
+	put_le16(p + 6, FRAME_V2_HEADER_LEN);
+	put_le64(p + 8, seq);
+	put_le64(p + 16, meta.timestamp_us);
+	put_le32(p + 24, meta.text_number);
+	put_le32(p + 28, meta.process_id);
+}
+
+void append_meta(std::string& buf, SentenceMeta const& meta)
+{
+	char p[SENTENCE_META_LEN];
+	put_le64(p, meta.timestamp_us);
+	put_le32(p + 8, meta.text_number);
+	put_le32(p + 12, meta.process_id);
+	buf.append(p, sizeof(p));
+}
+
+SentenceMeta get_meta(char const* p)
+{
+	SentenceMeta meta;
+	meta.timestamp_us = get_le64(p);
+	meta.text_number = get_le32(p + 8);
+	meta.process_id = get_le32(p + 12);
+	return meta;
+}
+
+void append_hello(std::string& buf, uint8_t version, uint8_t flags)
+{
+	char p[HELLO_LEN] = { 0 };
+	memcpy(p, HELLO_MAGIC, 4);
+	p[4] = (char) version;
+	p[5] = (char) flags;
+	buf.append(p, sizeof(p));
+}
+
+bool parse_hello(char const* p, uint8_t& version, uint8_t& flags)
+{
+	if (memcmp(p, HELLO_MAGIC, 4) != 0)
+		return false;
+
+	version = (uint8_t) p[4];
+	flags = (uint8_t) p[5];
+	return true;
+}
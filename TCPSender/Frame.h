@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Wire format. All integers are little endian.
+ *
+ * Legacy (version 1) frames are a 4 byte payload length followed by the
+ * UTF-8 sentence.
+ *
+ * Version 2 is only used after a handshake. Both sides send a hello of
+ * HELLO_LEN bytes: "TCPS", version, flags, 2 reserved bytes. The receiver
+ * answers with the version and the subset of flags it accepts. Frames are
+ * then:
+ *   u32 length of everything after this field
+ *   u8  version (2)
+ *   u8  type (FRAME_TYPE_SENTENCE)
+ *   u16 header length after the length field, payload starts behind it
+ *   u64 sequence number, starting at 1 and never reused by a sender
+ *   u64 capture time in microseconds since the Unix epoch
+ *   u32 Textractor text thread number
+ *   u32 process id of the hooked game
+ *   UTF-8 sentence
+ * Receivers should skip header bytes they do not know using the header
+ * length, later versions may append fields.
+ *
+ * If the receiver accepts HELLO_FLAG_ZSTD, everything the sender writes
+ * after the hellos is a single zstd stream, flushed after every write.
+ * Acks are never compressed.
+ */
+
+#define FRAME_VERSION_LEGACY 1
+#define FRAME_VERSION_2 2
+
+#define FRAME_V2_HEADER_LEN 28
+#define FRAME_TYPE_SENTENCE 0
+
+#define HELLO_MAGIC "TCPS"
+#define HELLO_LEN 8
+#define HELLO_FLAG_ACK 0x01
+#define HELLO_FLAG_ZSTD 0x02
+
+/**
+ * Information about a sentence taken when Textractor hands it over
+ */
+struct SentenceMeta {
+	uint64_t timestamp_us = 0;
+	uint32_t text_number = 0;
+	uint32_t process_id = 0;
+};
+
+// Size of a serialized SentenceMeta, e.g. in the spill log
+#define SENTENCE_META_LEN 16
+
+inline void put_le16(char* p, uint16_t v)
+{
+	p[0] = (char) (v & 0xff);
+	p[1] = (char) (v >> 8);
+}
+
+inline void put_le32(char* p, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i)
+		p[i] = (char) ((v >> (8 * i)) & 0xff);
+}
+
+inline void put_le64(char* p, uint64_t v)
+{
+	for (int i = 0; i < 8; ++i)
+		p[i] = (char) ((v >> (8 * i)) & 0xff);
+}
+
+inline uint32_t get_le32(char const* p)
+{
+	unsigned char const* u = (unsigned char const*) p;
+	return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+inline uint64_t get_le64(char const* p)
+{
+	return get_le32(p) | ((uint64_t) get_le32(p + 4) << 32);
+}
+
+/**
+ * Reserve a frame header of the given version at the end of buf. Append
+ * the UTF-8 payload, then call end_frame with the returned offset.
+ */
+size_t begin_frame(std::string& buf, int version);
+
+/**
+ * Fill in the header reserved by begin_frame. seq and meta are only used
+ * by version 2.
+ */
+void end_frame(std::string& buf, size_t off, int version, uint64_t seq,
+	SentenceMeta const& meta);
+
+/**
+ * Offset of the payload from the start of a frame
+ */
+inline size_t frame_payload_off(int version)
+{
+	return version >= FRAME_VERSION_2 ? 4 + FRAME_V2_HEADER_LEN : 4;
+}
+
+void append_meta(std::string& buf, SentenceMeta const& meta);
+SentenceMeta get_meta(char const* p);
+
+void append_hello(std::string& buf, uint8_t version, uint8_t flags);
+
+/**
+ * Parse HELLO_LEN bytes. Returns false if the magic does not match.
+ */
+bool parse_hello(char const* p, uint8_t& version, uint8_t& flags);
@@ -0,0 +1,121 @@
+#include "FramePool.h"
+
+#include <new>
+
+// Block size and count per class. Most sentences are a few dozen
+// characters, encoded with up to 3 bytes each.
+static struct {
+	uint32_t block_size;
+	uint32_t n_blocks;
+} const POOL_CLASSES[] = {
+	{256, 64},
+	{1024, 32},
+	{4096, 16},
+};
+
+#define POOL_NIL 0xffffffffu
+
+bool FramePool::SizeClass::pop(uint32_t& index)
+{
+	uint64_t h = head.load(std::memory_order_acquire);
+	for (;;) {
+		index = (uint32_t) h;
+		if (index == POOL_NIL)
+			return false;
+
+		uint32_t nxt = next[index].load(std::memory_order_relaxed);
+		uint64_t tag = (h >> 32) + 1;
+		if (head.compare_exchange_weak(h, (tag << 32) | nxt,
+				std::memory_order_acquire))
+			return true;
+	}
+}
+
+void FramePool::SizeClass::push(uint32_t index)
+{
+	uint64_t h = head.load(std::memory_order_relaxed);
+	for (;;) {
+		next[index].store((uint32_t) h, std::memory_order_relaxed);
+		uint64_t tag = (h >> 32) + 1;
+		if (head.compare_exchange_weak(h, (tag << 32) | index,
+				std::memory_order_release))
+			return;
+	}
+}
+
+FramePool::FramePool()
+{
+	n_classes = sizeof(POOL_CLASSES) / sizeof(POOL_CLASSES[0]);
+	classes.reset(new SizeClass[n_classes]);
+
+	size_t total = 0;
+	for (auto const& c : POOL_CLASSES)
+		total += (size_t) c.block_size * c.n_blocks;
+	memory.reset(new char[total]);
+
+	char* slab = memory.get();
+	for (size_t i = 0; i < n_classes; ++i) {
+		SizeClass& c = classes[i];
+		c.block_size = POOL_CLASSES[i].block_size;
+		c.n_blocks = POOL_CLASSES[i].n_blocks;
+		c.slab = slab;
+		slab += (size_t) c.block_size * c.n_blocks;
+
+		c.next.reset(new std::atomic<uint32_t>[c.n_blocks]);
+		for (uint32_t b = 0; b < c.n_blocks; ++b)
+			c.next[b].store(b + 1 < c.n_blocks ? b + 1 : POOL_NIL,
+				std::memory_order_relaxed);
+		c.head.store(0, std::memory_order_release);
+	}
+}
+
+FrameBuf FramePool::acquire(size_t size)
+{
+	FrameBuf fb;
+	fb.pool = this;
+
+	for (size_t i = 0; i < n_classes; ++i) {
+		SizeClass& c = classes[i];
+		uint32_t index;
+		if (size > c.block_size - FRAME_POOL_HEADER || !c.pop(index))
+			continue;
+
+		char* block = c.slab + (size_t) index * c.block_size;
+		new (block) std::atomic<uint32_t>{1};
+		fb.buf = block + FRAME_POOL_HEADER;
+		fb.cap = c.block_size - FRAME_POOL_HEADER;
+		fb.cls = (int) i;
+		fb.index = index;
+		n_hits.fetch_add(1, std::memory_order_relaxed);
+		add_bytes(c.block_size);
+		return fb;
+	}
+
+	char* block = new char[FRAME_POOL_HEADER + size];
+	new (block) std::atomic<uint32_t>{1};
+	fb.buf = block + FRAME_POOL_HEADER;
+	fb.cap = (uint32_t) size;
+	fb.cls = -1;
+	n_misses.fetch_add(1, std::memory_order_relaxed);
+	add_bytes(FRAME_POOL_HEADER + size);
+	return fb;
+}
+
+void FramePool::release(FrameBuf& fb)
+{
+	n_bytes.fetch_sub(FRAME_POOL_HEADER + fb.cap, std::memory_order_relaxed);
+
+	if (fb.cls < 0)
+		delete[] (fb.buf - FRAME_POOL_HEADER);
+	else
+		classes[fb.cls].push(fb.index);
+}
+
+void FramePool::add_bytes(uint64_t n)
+{
+	uint64_t now = n_bytes.fetch_add(n, std::memory_order_relaxed) + n;
+	uint64_t peak = n_peak.load(std::memory_order_relaxed);
+	while (now > peak && !n_peak.compare_exchange_weak(peak, now,
+			std::memory_order_relaxed))
+		;
+}
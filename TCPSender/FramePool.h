@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class FramePool;
+
+// Bytes in front of each buffer holding the reference count
+#define FRAME_POOL_HEADER 8
+
+/**
+ * Reference to a buffer taken from a FramePool. The buffer goes back to the
+ * pool when the last reference is reset or destroyed. Fill it before
+ * sharing, shared buffers are read-only.
+ */
+class FrameBuf {
+public:
+	FrameBuf() = default;
+	FrameBuf(FrameBuf&& other) noexcept { take(other); }
+	FrameBuf& operator=(FrameBuf&& other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			take(other);
+		}
+		return *this;
+	}
+	~FrameBuf() { reset(); }
+
+	FrameBuf(FrameBuf const&) = delete;
+	FrameBuf& operator=(FrameBuf const&) = delete;
+
+	/**
+	 * Another reference to the same buffer
+	 */
+	FrameBuf share() const;
+
+	char* data() { return buf; }
+	char const* data() const { return buf; }
+	size_t size() const { return len; }
+	size_t capacity() const { return cap; }
+	void set_size(size_t n) { len = (uint32_t) n; }
+
+	/**
+	 * Give the storage back to the pool
+	 */
+	void reset();
+
+private:
+	friend class FramePool;
+
+	void take(FrameBuf& other)
+	{
+		pool = other.pool;
+		buf = other.buf;
+		cap = other.cap;
+		len = other.len;
+		cls = other.cls;
+		index = other.index;
+		other.pool = nullptr;
+		other.buf = nullptr;
+		other.cap = other.len = 0;
+	}
+
+	FramePool* pool = nullptr;
+	char* buf = nullptr;
+	uint32_t cap = 0;
+	uint32_t len = 0;
+	int cls = -1; // Size class, -1 for oversized heap buffers
+	uint32_t index = 0;
+};
+
+/**
+ * Preallocated slabs of fixed size blocks for queued sentences.
+ *
+ * Blocks come in a few size classes picked for typical sentence lengths.
+ * A request takes a free block of the smallest class that fits, falling
+ * back to larger classes and finally to the heap for oversized sentences
+ * or when the slabs are exhausted. Acquiring and releasing are lock-free
+ * and safe from any thread.
+ *
+ * Every buffer starts with a reference count in front of data(), so one
+ * encoded sentence can be queued for several receivers.
+ */
+class FramePool {
+public:
+	FramePool();
+
+	FramePool(FramePool const&) = delete;
+	FramePool& operator=(FramePool const&) = delete;
+
+	/**
+	 * Buffer with room for at least size bytes
+	 */
+	FrameBuf acquire(size_t size);
+
+	// Requests served from the slabs and from the heap
+	uint64_t hits() const { return n_hits.load(std::memory_order_relaxed); }
+	uint64_t misses() const { return n_misses.load(std::memory_order_relaxed); }
+
+	// Bytes handed out, slab blocks counted at their full size
+	uint64_t bytes_in_use() const { return n_bytes.load(std::memory_order_relaxed); }
+	uint64_t peak_bytes() const { return n_peak.load(std::memory_order_relaxed); }
+
+private:
+	friend class FrameBuf;
+
+	static std::atomic<uint32_t>& refs(FrameBuf const& buf);
+	void release(FrameBuf& buf);
+	void add_bytes(uint64_t n);
+
+	/**
+	 * Free list of one size class. Blocks are linked by index, the head
+	 * carries a tag against ABA.
+	 */
+	struct SizeClass {
+		uint32_t block_size;
+		uint32_t n_blocks;
+		char* slab;
+		std::unique_ptr<std::atomic<uint32_t>[]> next;
+		std::atomic<uint64_t> head;
+
+		bool pop(uint32_t& index);
+		void push(uint32_t index);
+	};
+
+	std::unique_ptr<char[]> memory;
+	std::unique_ptr<SizeClass[]> classes;
+	size_t n_classes;
+
+	std::atomic<uint64_t> n_hits{0};
+	std::atomic<uint64_t> n_misses{0};
+	std::atomic<uint64_t> n_bytes{0};
+	std::atomic<uint64_t> n_peak{0};
+};
+
+inline std::atomic<uint32_t>& FramePool::refs(FrameBuf const& buf)
+{
+	return *(std::atomic<uint32_t>*) (buf.buf - FRAME_POOL_HEADER);
+}
+
+inline FrameBuf FrameBuf::share() const
+{
+	FrameBuf other;
+	if (pool) {
+		FramePool::refs(*this).fetch_add(1, std::memory_order_relaxed);
+		other.pool = pool;
+		other.buf = buf;
+		other.cap = cap;
+		other.len = len;
+		other.cls = cls;
+		other.index = index;
+	}
+	return other;
+}
+
+inline void FrameBuf::reset()
+{
+	if (pool && FramePool::refs(*this).fetch_sub(1,
+			std::memory_order_acq_rel) == 1)
+		pool->release(*this);
+	pool = nullptr;
+	buf = nullptr;
+	cap = len = 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "MsgQueue.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Set of MsgQueues ("lanes") drained in round-robin order.
+ *
+ * Each lane overflows on its own, so a busy producer only ever evicts its
+ * own elements and gets at most every n-th pop while other lanes have data.
+ * Pushing is safe from any thread, popping is for a single consumer.
+ */
+template <typename T>
+class LaneQueue {
+public:
+	LaneQueue(size_t n_lanes, size_t lane_capacity)
+	{
+		for (size_t i = 0; i < n_lanes; ++i)
+			lanes.emplace_back(new MsgQueue<T>{lane_capacity});
+	}
+
+	LaneQueue(LaneQueue const&) = delete;
+	LaneQueue& operator=(LaneQueue const&) = delete;
+
+	/**
+	 * Push into the given lane, see MsgQueue::push
+	 */
+	template <typename F>
+	bool push(size_t lane, F&& fill, DropPolicy policy)
+	{
+		return lanes[lane]->push(std::forward<F>(fill), policy);
+	}
+
+	/**
+	 * Swap the oldest element of the next non-empty lane into out.
+	 * Returns false if all lanes are empty.
+	 */
+	bool pop(T& out)
+	{
+		for (size_t i = 0; i < lanes.size(); ++i) {
+			size_t lane = next_lane;
+			next_lane = (next_lane + 1) % lanes.size();
+			if (lanes[lane]->pop(out))
+				return true;
+		}
+		return false;
+	}
+
+	bool empty() const
+	{
+		for (auto const& lane : lanes)
+			if (!lane->empty())
+				return false;
+		return true;
+	}
+
+	size_t lane_count() const { return lanes.size(); }
+
+	/**
+	 * Limit each lane to n elements, see MsgQueue::set_limit
+	 */
+	void set_lane_limit(size_t n)
+	{
+		for (auto const& lane : lanes)
+			lane->set_limit(n);
+	}
+
+	/**
+	 * Number of queued elements in all lanes, see MsgQueue::size
+	 */
+	size_t size() const
+	{
+		size_t n = 0;
+		for (auto const& lane : lanes)
+			n += lane->size();
+		return n;
+	}
+
+	/**
+	 * Number of elements lost to overflow in all lanes
+	 */
+	uint64_t dropped() const
+	{
+		uint64_t n = 0;
+		for (auto const& lane : lanes)
+			n += lane->dropped();
+		return n;
+	}
+
+private:
+	std::vector<std::unique_ptr<MsgQueue<T>>> lanes;
+	size_t next_lane = 0;
+};
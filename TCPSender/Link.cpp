@@ -0,0 +1,573 @@
+#include "Link.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <chrono>
+
+using std::string;
+using std::wstring;
+
+// Batches a link may send in one step before giving others a turn
+#define LINK_MAX_BATCHES_PER_STEP 16
+
+/**
+ * Pop queued messages and append them as frames to batch until the queue
+ * is empty or the batch limits are reached.
+ * Returns the number of frames in batch.
+ */
+static size_t fill_batch(Batch& batch, LaneQueue<Sentence>& queue,
+	Sentence& msg, StageTrace* trace)
+{
+	while ((batch.n == 0 || !batch.full()) && queue.pop(msg)) {
+		if (msg.entry_ns != 0 && trace && trace->enabled()) {
+			uint64_t now = StageTrace::now_ns();
+			trace->record(Stage::QUEUED, msg.enqueued_ns, now);
+			batch.traced.push_back(FrameTrace{msg.entry_ns, now});
+		}
+
+		batch.add(msg.meta, [&](string& buf) {
+			buf.append(msg.text.data(), msg.text.size());
+		});
+		msg.text.reset();
+	}
+	return batch.n;
+}
+
+/**
+ * Move all queued messages to the end of the spill log. Records hold the
+ * serialized SentenceMeta followed by the UTF-8 text.
+ */
+static void spill_pending(SpillLog& spill, LaneQueue<Sentence>& queue,
+	Sentence& msg, string& scratch)
+{
+	while (queue.pop(msg)) {
+		scratch.clear();
+		append_meta(scratch, msg.meta);
+		scratch.append(msg.text.data(), msg.text.size());
+		msg.text.reset();
+		if (!spill.push(scratch.data(), scratch.length()))
+			LOG_DEBUG("Spill log full, dropping sentence");
+	}
+}
+
+/**
+ * Append spilled sentences, oldest first and starting skip bytes into the
+ * log, as frames to batch within the batch limits and note the part of the
+ * spill log covered.
+ * Returns the number of frames in batch.
+ */
+static size_t fill_batch_from_spill(Batch& batch, SpillLog const& spill,
+	uint64_t skip)
+{
+	uint64_t start = spill.begin() + skip;
+	uint64_t pos = start;
+	uint64_t next = pos;
+	char const* data;
+	uint32_t len;
+
+	while (spill.read(next, data, len)) {
+		if (len < SENTENCE_META_LEN) {
+			pos = next;
+			continue;
+		}
+
+		bool added = batch.add(get_meta(data), [&](string& buf) {
+			buf.append(data + SENTENCE_META_LEN, len - SENTENCE_META_LEN);
+		});
+		if (!added)
+			break;
+		pos = next;
+	}
+
+	batch.spill_bytes = pos - start;
+	return batch.n;
+}
+
+bool Link::open_spill(wstring const& filepath, uint64_t capacity)
+{
+	return spill.open(filepath, capacity);
+}
+
+void Link::close_spill()
+{
+	// Batches taken from the log no longer refer to it
+	batch.spill_bytes = 0;
+	for (WindowBatch& b : window_batches)
+		b.spill_bytes = 0;
+	spill_inflight = 0;
+	spill.close();
+}
+
+Link::clock::time_point Link::step(Reactor& reactor, clock::time_point now,
+	Config const& cfg, wstring const& remote, bool wanted,
+	LaneQueue<Sentence>& queue)
+{
+	auto deadline = clock::time_point::max();
+	ack_window = cfg.ack_mode ? cfg.ack_window : 0;
+
+	if (!wanted) {
+		if (phase == Phase::HANDSHAKE || phase == Phase::OPEN)
+			LOG_INFO("Disconnecting from " + remote_name);
+		if (phase != Phase::IDLE) {
+			close();
+			dns_cache.detach();
+			phase = Phase::IDLE;
+		}
+		set_state(ConnState::DISCONNECTED);
+		spill_queued(queue);
+		return deadline;
+	}
+
+	// Explicit connect requests start a fresh schedule
+	if (phase == Phase::IDLE) {
+		backoff.reset();
+		next_attempt = now;
+		phase = Phase::WAITING;
+	}
+
+	if (phase == Phase::WAITING) {
+		if (now < next_attempt) {
+			spill_queued(queue);
+			return next_attempt;
+		}
+		start_connect(cfg, remote);
+	}
+
+	if (phase == Phase::RESOLVING)
+		resolve(reactor, now, cfg, remote);
+
+	if (phase == Phase::CONNECTING) {
+		SOCKET s = connector.step(reactor, now, deadline);
+		if (s != INVALID_SOCKET) {
+			sock = s;
+			if (!connected(now, cfg))
+				fail_connect(now, "Could not start the connection");
+		} else if (connector.failed()) {
+			fail_connect(now, "Connection failed");
+		}
+	}
+
+	if (phase == Phase::HANDSHAKE) {
+		if (!flush(reactor)) {
+			fail_connect(now, "Error sending hello");
+		} else if ((reactor.ready(sock) & REACTOR_READ) && !read_hello(cfg)) {
+			fail_connect(now, "Handshake failed, receiver does not support"
+				" the configured protocol");
+		} else if (phase == Phase::HANDSHAKE && now >= handshake_deadline) {
+			fail_connect(now, "Handshake timed out");
+		} else if (phase == Phase::HANDSHAKE) {
+			reactor.watch(sock, REACTOR_READ);
+			deadline = std::min(deadline, handshake_deadline);
+		}
+	}
+
+	if (phase != Phase::OPEN)
+		spill_queued(queue);
+	if (phase == Phase::WAITING)
+		return next_attempt;
+	if (phase != Phase::OPEN)
+		return deadline;
+
+	// Acks, or just a closed connection outside of ack mode
+	if ((reactor.ready(sock) & REACTOR_READ) && !read_acks(cfg.ack_mode)) {
+		drop(now, "Connection closed by receiver");
+		return next_attempt;
+	}
+
+	for (int i = 0; i < LINK_MAX_BATCHES_PER_STEP; ++i) {
+		if (out_kind == Output::NONE && !fill(now, cfg, queue, deadline)) {
+			drop(now, "Error compressing");
+			return next_attempt;
+		}
+		if (out_kind == Output::NONE)
+			break;
+
+		if (!flush(reactor)) {
+			drop(now, "Error sending");
+			return next_attempt;
+		}
+		if (out_kind != Output::NONE)
+			break;
+
+		if (i + 1 == LINK_MAX_BATCHES_PER_STEP)
+			deadline = now;
+	}
+
+	reactor.watch(sock, REACTOR_READ);
+	return deadline;
+}
+
+bool Link::takes_input() const
+{
+	if (phase != Phase::OPEN)
+		return spill.is_open();
+	return out_kind == Output::NONE
+		&& (ack_window == 0 || window.size() < ack_window);
+}
+
+/**
+ * Keep the queue from overflowing until the receiver is back
+ */
+void Link::spill_queued(LaneQueue<Sentence>& queue)
+{
+	if (spill.is_open())
+		spill_pending(spill, queue, msg, spill_scratch);
+}
+
+bool Link::take_state_changed()
+{
+	bool changed = state_changed;
+	state_changed = false;
+	return changed;
+}
+
+void Link::set_state(ConnState state)
+{
+	if (conn_state.exchange(state) != state)
+		state_changed = true;
+}
+
+void Link::start_connect(Config const& cfg, wstring const& remote)
+{
+	remote_name = to_utf8(remote);
+	backoff.configure(cfg.reconnect_initial_ms, cfg.reconnect_multiplier,
+		cfg.reconnect_max_ms, cfg.reconnect_jitter_pct);
+	set_state(ConnState::CONNECTING);
+	LOG_INFO("Connecting to " + remote_name);
+	phase = Phase::RESOLVING;
+}
+
+void Link::resolve(Reactor& reactor, clock::time_point now,
+	Config const& cfg, wstring const& remote)
+{
+	// Lookups run on the DNS worker, which wakes the reactor once done
+	DnsStatus dns = dns_cache.resolve(remote, cfg.dns_ttl_ms, reactor);
+	if (dns == DnsStatus::PENDING)
+		return;
+
+	LOG_DEBUG("DNS cache: " + std::to_string(dns_cache.hits()) + " hits, "
+		+ std::to_string(dns_cache.misses()) + " misses");
+	if (dns == DnsStatus::FAILED) {
+		fail_connect(now, "Could not resolve remote");
+		return;
+	}
+
+	connector.start(dns_cache.addresses(), cfg.connect_stagger_ms,
+		cfg.connect_timeout_ms);
+	phase = Phase::CONNECTING;
+}
+
+bool Link::connected(clock::time_point now, Config const& cfg)
+{
+	healthy = false;
+	frame_version = cfg.frame_version >= FRAME_VERSION_2
+		? FRAME_VERSION_2 : FRAME_VERSION_LEGACY;
+
+	if (frame_version == FRAME_VERSION_LEGACY)
+		return open(cfg);
+
+	// Ask for version 2 with acks if configured, which the receiver has to
+	// accept, and compression, which is optional
+	offer_flags = cfg.ack_mode ? HELLO_FLAG_ACK : 0;
+	if (cfg.compression && StreamCompressor::available())
+		offer_flags |= HELLO_FLAG_ZSTD;
+
+	string h;
+	append_hello(h, FRAME_VERSION_2, offer_flags);
+
+	phase = Phase::HANDSHAKE;
+	hello_have = 0;
+	handshake_deadline = now + std::chrono::milliseconds{cfg.connect_timeout_ms};
+	return set_output(Output::HELLO, h.data(), h.size());
+}
+
+bool Link::read_hello(Config const& cfg)
+{
+	long got = socket_recv(sock, hello + hello_have, HELLO_LEN - hello_have);
+	if (got < 0)
+		return false;
+
+	hello_have += got;
+	if (hello_have < HELLO_LEN)
+		return true;
+
+	uint8_t version, flags;
+	if (!parse_hello(hello, version, flags) || version != FRAME_VERSION_2)
+		return false;
+
+	flags &= offer_flags;
+	uint8_t want_flags = cfg.ack_mode ? HELLO_FLAG_ACK : 0;
+	if ((flags & want_flags) != want_flags)
+		return false;
+
+	if (flags & HELLO_FLAG_ZSTD) {
+		if (!zs.start((int) cfg.compression_level)) {
+			LOG_ERROR("Could not start compression");
+			return false;
+		}
+		LOG_DEBUG("Compressing with zstd");
+	}
+
+	return open(cfg);
+}
+
+bool Link::open(Config const& cfg)
+{
+	(void) cfg;
+	phase = Phase::OPEN;
+
+	// A batch left by the last connection may use another version
+	if (retry)
+		batch.set_version(frame_version);
+
+	window.restart();
+	if (frame_version == FRAME_VERSION_LEGACY) {
+		window.renumber(1);
+		conn_seq = 1 + window.size();
+	}
+
+	set_state(ConnState::CONNECTED);
+	LinkStats::add(counters.connects);
+	LOG_INFO("Successfully connected to " + remote_name);
+
+	// Frames left unacknowledged by the last connection go first
+	if (!window.empty())
+		return set_output(Output::RESEND, window.data(), window.bytes());
+	return true;
+}
+
+void Link::fail_connect(clock::time_point now, char const* reason)
+{
+	LOG_ERROR(string{reason} + " (" + remote_name + ")");
+	LinkStats::add(counters.connect_failures);
+	close();
+
+	auto delay = backoff.next_delay();
+	next_attempt = now + delay;
+	phase = Phase::WAITING;
+
+	retry_delay = (unsigned) delay.count();
+	retry_attempts = backoff.attempts();
+	state_changed = true;
+	set_state(ConnState::WAITING);
+	LOG_INFO("Connection to " + remote_name + " failed. Retrying in "
+		+ std::to_string(delay.count()) + "ms.");
+}
+
+void Link::drop(clock::time_point now, char const* reason)
+{
+	LOG_ERROR(string{reason} + " (" + remote_name + ")");
+	LinkStats::add(counters.disconnects);
+	close();
+
+	auto delay = healthy ? std::chrono::milliseconds{0} : backoff.next_delay();
+	next_attempt = now + delay;
+	phase = Phase::WAITING;
+
+	if (delay.count() > 0) {
+		retry_delay = (unsigned) delay.count();
+		retry_attempts = backoff.attempts();
+		state_changed = true;
+		set_state(ConnState::WAITING);
+	}
+}
+
+void Link::close()
+{
+	connector.cancel();
+	if (sock != INVALID_SOCKET)
+		close_socket(sock);
+	sock = INVALID_SOCKET;
+
+	// The batch being collected goes out on the next connection, as does
+	// the one in flight outside of ack mode, where the window resends it
+	if (collecting || (out_kind == Output::BATCH && ack_window == 0))
+		retry = true;
+	collecting = false;
+
+	out_kind = Output::NONE;
+	out = nullptr;
+	out_len = out_off = 0;
+	zs.stop();
+}
+
+bool Link::read_acks(bool ack_mode)
+{
+	char buf[64 * ACK_LEN];
+
+	for (;;) {
+		long got = socket_recv(sock, buf, sizeof(buf));
+		if (got < 0)
+			return false;
+		if (got == 0)
+			return true;
+
+		if (ack_mode)
+			release_acked(window.feed(buf, got));
+	}
+}
+
+/**
+ * Consume the spill log behind batches the window released
+ */
+void Link::release_acked(size_t n_frames)
+{
+	while (n_frames > 0 && !window_batches.empty()) {
+		WindowBatch& b = window_batches.front();
+		size_t n = std::min(n_frames, b.n);
+		b.n -= n;
+		n_frames -= n;
+
+		if (b.n == 0) {
+			spill.consume(b.spill_bytes);
+			spill_inflight -= b.spill_bytes;
+			window_batches.pop_front();
+		}
+	}
+}
+
+bool Link::fill(clock::time_point now, Config const& cfg,
+	LaneQueue<Sentence>& queue, clock::time_point& deadline)
+{
+	if (retry) {
+		retry = false;
+		return finish_batch(cfg);
+	}
+
+	if (cfg.ack_mode && window.size() >= cfg.ack_window)
+		return true;
+
+	if (!collecting) {
+		size_t max_msgs = cfg.batch_max_msgs;
+		if (cfg.ack_mode)
+			max_msgs = std::min(max_msgs, cfg.ack_window - window.size());
+		batch.reset(frame_version, next_seq, max_msgs, cfg.batch_max_bytes);
+
+		// Replay spilled sentences not yet sent first. Anything newly
+		// queued goes behind them to keep the order.
+		if (spill.size() > spill_inflight) {
+			spill_pending(spill, queue, msg, spill_scratch);
+			if (fill_batch_from_spill(batch, spill, spill_inflight) == 0)
+				return true;
+			return finish_batch(cfg);
+		}
+
+		if (fill_batch(batch, queue, msg, trace) == 0)
+			return true;
+
+		collecting = true;
+		batch_deadline = now + std::chrono::milliseconds{cfg.batch_latency_ms};
+	} else {
+		fill_batch(batch, queue, msg, trace);
+	}
+
+	// Wait for more within the latency budget if allowed
+	if (!batch.full() && now < batch_deadline) {
+		deadline = std::min(deadline, batch_deadline);
+		return true;
+	}
+
+	collecting = false;
+	return finish_batch(cfg);
+}
+
+bool Link::finish_batch(Config const& cfg)
+{
+	next_seq = batch.first_seq + batch.n;
+
+	// In ack mode the window keeps the batch until it is acknowledged and
+	// resends it if the connection fails. Its spilled records are consumed
+	// by the ack, runs of batches without any are tracked as one.
+	if (cfg.ack_mode) {
+		if (batch.version >= FRAME_VERSION_2) {
+			window.push(batch.buf.data(), batch.buf.size(), batch.first_seq);
+		} else {
+			window.push(batch.buf.data(), batch.buf.size(), conn_seq);
+			conn_seq += batch.n;
+		}
+
+		if (batch.spill_bytes == 0 && !window_batches.empty()
+				&& window_batches.back().spill_bytes == 0)
+			window_batches.back().n += batch.n;
+		else
+			window_batches.push_back(WindowBatch{batch.n, batch.spill_bytes});
+		spill_inflight += batch.spill_bytes;
+		batch.spill_bytes = 0;
+	}
+
+	return set_output(Output::BATCH, batch.buf.data(), batch.buf.size());
+}
+
+bool Link::set_output(Output kind, char const* data, size_t len)
+{
+	if (zs.active()) {
+		if (!zs.compress(data, len, wire))
+			return false;
+		out = wire.data();
+		out_len = wire.size();
+	} else if (kind != Output::BATCH) {
+		// The window may release frames while they are being resent
+		wire.assign(data, len);
+		out = wire.data();
+		out_len = wire.size();
+	} else {
+		out = data;
+		out_len = len;
+	}
+
+	out_kind = kind;
+	out_off = 0;
+	return true;
+}
+
+bool Link::flush(Reactor& reactor)
+{
+	while (out_off < out_len) {
+		long sent = socket_send(sock, out + out_off, out_len - out_off);
+		if (sent < 0)
+			return false;
+		if (sent == 0) {
+			reactor.watch(sock, REACTOR_WRITE);
+			return true;
+		}
+		out_off += sent;
+		LinkStats::add(counters.bytes_sent, sent);
+	}
+
+	if (out_kind != Output::NONE)
+		output_done();
+	return true;
+}
+
+void Link::output_done()
+{
+	if (out_kind == Output::BATCH) {
+		if (!healthy)
+			backoff.reset();
+		healthy = true;
+
+		spill.consume(batch.spill_bytes);
+		batch.spill_bytes = 0;
+
+		uint64_t now_us = (uint64_t) std::chrono::duration_cast<
+			std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+		for (SentenceMeta const& meta : batch.metas) {
+			uint64_t captured = meta.timestamp_us;
+			counters.send_latency_us.record(now_us > captured ? now_us - captured : 0);
+		}
+		LinkStats::add(counters.sentences_sent, batch.n);
+
+		if (trace && !batch.traced.empty()) {
+			uint64_t sent_ns = StageTrace::now_ns();
+			for (FrameTrace const& f : batch.traced) {
+				trace->record(Stage::SEND, f.dequeued_ns, sent_ns);
+				trace->record(Stage::TOTAL, f.entry_ns, sent_ns);
+			}
+		}
+	}
+
+	out_kind = Output::NONE;
+	out = nullptr;
+	out_len = out_off = 0;
+}
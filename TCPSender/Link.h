@@ -0,0 +1,310 @@
+#pragma once
+
+#include "AckWindow.h"
+#include "Backoff.h"
+#include "Compress.h"
+#include "Config.h"
+#include "Frame.h"
+#include "FramePool.h"
+#include "LaneQueue.h"
+#include "Log.h"
+#include "Net.h"
+#include "Reactor.h"
+#include "SpillLog.h"
+#include "Stats.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Queued sentence with the metadata taken when it was received. The text
+ * is encoded to UTF-8 by the hook thread into a buffer from a FramePool,
+ * which goes back to the pool once the text is batched or spilled.
+ */
+struct Sentence {
+	FrameBuf text;
+	SentenceMeta meta;
+
+	// Stage timestamps if traced, see StageTrace
+	uint64_t entry_ns = 0;
+	uint64_t enqueued_ns = 0;
+};
+
+enum class ConnState {
+	DISCONNECTED,
+	CONNECTING,
+	CONNECTED,
+	WAITING
+};
+
+/**
+ * Frames collected for one write
+ */
+struct Batch {
+	std::string buf;
+	size_t n = 0;
+	int version = FRAME_VERSION_LEGACY;
+
+	// Sequence number of the first frame, the others follow consecutively
+	uint64_t first_seq = 1;
+
+	// Part of the spill log in buf, to be consumed once sent or, in ack
+	// mode, once acknowledged
+	uint64_t spill_bytes = 0;
+
+	// Metadata of each frame, for the send latency and to encode the
+	// frames again
+	std::vector<SentenceMeta> metas;
+
+	// Frames taken from the queue while tracing
+	std::vector<FrameTrace> traced;
+
+	// Limits, see Config
+	size_t max_msgs = 1;
+	size_t max_bytes = 0;
+
+	void reset(int version, uint64_t first_seq, size_t max_msgs,
+		size_t max_bytes)
+	{
+		buf.clear();
+		n = 0;
+		this->version = version;
+		this->first_seq = first_seq;
+		this->max_msgs = max_msgs;
+		this->max_bytes = max_bytes;
+		spill_bytes = 0;
+		metas.clear();
+		traced.clear();
+	}
+
+	bool full() const { return n >= max_msgs || buf.size() >= max_bytes; }
+
+	/**
+	 * Append text as frame. A batch always takes at least one frame.
+	 * Returns false if the batch limits are reached.
+	 */
+	template <typename F>
+	bool add(SentenceMeta const& meta, F&& append_text)
+	{
+		if (n > 0 && full())
+			return false;
+
+		size_t off = begin_frame(buf, version);
+		append_text(buf);
+		end_frame(buf, off, version, first_seq + n, meta);
+		metas.push_back(meta);
+		++n;
+
+		LOG_TRACE("Sending '" + buf.substr(off + frame_payload_off(version)) + "'");
+		return true;
+	}
+
+	/**
+	 * Encode the frames again in another version, keeping their sequence
+	 * numbers, e.g. to retry them on a connection that agreed on it
+	 */
+	void set_version(int version)
+	{
+		if (version == this->version)
+			return;
+
+		std::string old;
+		old.swap(buf);
+		size_t old_payload = frame_payload_off(this->version);
+		this->version = version;
+
+		size_t pos = 0;
+		for (size_t i = 0; i < n; ++i) {
+			size_t end = pos + 4 + get_le32(old.data() + pos);
+			size_t off = begin_frame(buf, version);
+			buf.append(old, pos + old_payload, end - pos - old_payload);
+			end_frame(buf, off, version, first_seq + i, metas[i]);
+			pos = end;
+		}
+	}
+};
+
+/**
+ * Connection to one receiver, driven by the I/O loop without blocking.
+ *
+ * Covers the whole life of the connection: reconnect schedule, connecting,
+ * the version 2 handshake, batching queued sentences, partial writes,
+ * acks and the spill log. Everything but the state shown in the dialog
+ * belongs to the I/O thread.
+ */
+class Link {
+public:
+	using clock = std::chrono::steady_clock;
+
+	/**
+	 * Open the spill log, see Config::spill_file
+	 */
+	bool open_spill(std::wstring const& filepath, uint64_t capacity);
+	void close_spill();
+	uint64_t spill_size() const { return spill.size(); }
+
+	/**
+	 * Resolve the remote again on the next attempt
+	 */
+	void invalidate_dns() { dns_cache.invalidate(); }
+
+	/**
+	 * Advance the connection. Handles what the last reactor wait reported,
+	 * sends what can be sent from queue and watches the socket for the next
+	 * wait. wanted is false if the link should be disconnected.
+	 * Returns when step has to run again at the latest.
+	 */
+	clock::time_point step(Reactor& reactor, clock::time_point now,
+		Config const& cfg, std::wstring const& remote, bool wanted,
+		LaneQueue<Sentence>& queue);
+
+	/**
+	 * True if step would make progress on newly queued sentences, by
+	 * sending them or, until the connection is open, spilling them
+	 */
+	bool takes_input() const;
+
+	/**
+	 * True if the remote was looked up and step would pick up the answer
+	 */
+	bool resolved() const
+	{
+		return phase == Phase::RESOLVING && dns_cache.done();
+	}
+
+	// Shown in the dialog
+	ConnState state() const { return conn_state.load(); }
+	unsigned retry_delay_ms() const { return retry_delay.load(); }
+	unsigned retry_attempt() const { return retry_attempts.load(); }
+
+	/**
+	 * True once after the state changed
+	 */
+	bool take_state_changed();
+
+	LinkStats const& stats() const { return counters; }
+
+	/**
+	 * Record the stages from dequeuing on into trace
+	 */
+	void set_trace(StageTrace* trace) { this->trace = trace; }
+
+private:
+	enum class Phase {
+		IDLE,       // Not wanted
+		WAITING,    // Until next_attempt
+		RESOLVING,  // Looking up the remote on the DNS worker
+		CONNECTING,
+		HANDSHAKE,  // Hello sent, waiting for the reply
+		OPEN
+	};
+
+	// What the pending output holds
+	enum class Output {
+		NONE,
+		HELLO,
+		RESEND,
+		BATCH
+	};
+
+	void set_state(ConnState state);
+	void start_connect(Config const& cfg, std::wstring const& remote);
+	void resolve(Reactor& reactor, clock::time_point now, Config const& cfg,
+		std::wstring const& remote);
+	bool connected(clock::time_point now, Config const& cfg);
+	bool open(Config const& cfg);
+	void fail_connect(clock::time_point now, char const* reason);
+	void drop(clock::time_point now, char const* reason);
+	void close();
+
+	void spill_queued(LaneQueue<Sentence>& queue);
+	bool read_hello(Config const& cfg);
+	bool read_acks(bool ack_mode);
+	void release_acked(size_t n_frames);
+	bool fill(clock::time_point now, Config const& cfg,
+		LaneQueue<Sentence>& queue, clock::time_point& deadline);
+	bool finish_batch(Config const& cfg);
+	bool set_output(Output kind, char const* data, size_t len);
+	bool flush(Reactor& reactor);
+	void output_done();
+
+	Phase phase = Phase::IDLE;
+	SOCKET sock = INVALID_SOCKET;
+	Connector connector;
+	DnsCache dns_cache;
+	std::string remote_name;
+
+	// Reconnect schedule. A connection counts as healthy once it delivered
+	// data, losing a healthy connection reconnects right away while
+	// connections that fail immediately keep backing off.
+	Backoff backoff;
+	clock::time_point next_attempt;
+	bool healthy = false;
+
+	// Handshake reply and the flags offered in the hello
+	char hello[HELLO_LEN];
+	size_t hello_have = 0;
+	uint8_t offer_flags = 0;
+	clock::time_point handshake_deadline;
+
+	// Bytes being written, pointing into batch.buf or wire
+	Output out_kind = Output::NONE;
+	char const* out = nullptr;
+	size_t out_len = 0;
+	size_t out_off = 0;
+	std::string wire;
+
+	// Frames being collected or sent and scratch space for popping
+	// messages. A batch is collected for up to batch_latency_ms. If the
+	// connection closes while collecting or, outside of ack mode, before it
+	// was sent, it is kept for a retry on the next one.
+	Batch batch;
+	Sentence msg;
+	bool collecting = false;
+	clock::time_point batch_deadline;
+	bool retry = false;
+
+	// Frame version agreed on for the current connection and the sequence
+	// number of the next new frame
+	int frame_version = FRAME_VERSION_LEGACY;
+	uint64_t next_seq = 1;
+
+	// Optional on-disk overflow while the receiver is unreachable
+	SpillLog spill;
+	std::string spill_scratch;
+
+	// Unacknowledged frames in ack mode, resent after reconnecting.
+	// Legacy frames are numbered per connection by conn_seq.
+	AckWindow window;
+	uint64_t conn_seq = 1;
+
+	// Batches in the window, oldest first, with the part of the spill log
+	// each one covers. Spilled records stay in the log until their whole
+	// batch is acknowledged, so they survive a crash in between.
+	// spill_inflight is the sum, replay continues behind it.
+	struct WindowBatch {
+		size_t n;
+		uint64_t spill_bytes;
+	};
+	std::deque<WindowBatch> window_batches;
+	uint64_t spill_inflight = 0;
+
+	// Window limit in ack mode, 0 otherwise
+	unsigned ack_window = 0;
+
+	// Compression of the current connection, if negotiated
+	StreamCompressor zs;
+
+	std::atomic<ConnState> conn_state{ConnState::DISCONNECTED};
+	std::atomic<unsigned> retry_delay{0};
+	std::atomic<unsigned> retry_attempts{0};
+	bool state_changed = false;
+
+	LinkStats counters;
+	StageTrace* trace = nullptr;
+};
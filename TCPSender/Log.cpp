@@ -0,0 +1,26 @@
+#include "Log.h"
+
+std::atomic<LogLevel> log_level{LogLevel::INFO};
+
+static wchar_t const* const level_names[] = {
+	L"error",
+	L"info",
+	L"debug",
+	L"trace"
+};
+
+bool parse_log_level(std::wstring const& name, LogLevel& level)
+{
+	for (int i = 0; i < (int) (sizeof(level_names) / sizeof(*level_names)); ++i) {
+		if (name == level_names[i]) {
+			level = (LogLevel) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+wchar_t const* log_level_name(LogLevel level)
+{
+	return level_names[(int) level];
+}
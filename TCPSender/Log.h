@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+enum class LogLevel {
+	ERR,
+	INFO,
+	DEBUG,
+	TRACE
+};
+
+// Messages above this level are discarded. Set from the config file.
+extern std::atomic<LogLevel> log_level;
+
+/**
+ * Write a line to the log window. Prefer the LOG_* macros, which skip
+ * building the message if its level is disabled.
+ */
+void log(std::string const& msg);
+void log(std::wstring const& msg);
+
+inline bool log_enabled(LogLevel level)
+{
+	return level <= log_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns false and leaves level untouched if name is unknown
+ */
+bool parse_log_level(std::wstring const& name, LogLevel& level);
+wchar_t const* log_level_name(LogLevel level);
+
+// The message expression is only evaluated if the level is enabled
+#define LOG_AT(level, msg) \
+	do { if (log_enabled(level)) log(msg); } while (0)
+
+#define LOG_ERROR(msg) LOG_AT(LogLevel::ERR, msg)
+#define LOG_INFO(msg) LOG_AT(LogLevel::INFO, msg)
+#define LOG_DEBUG(msg) LOG_AT(LogLevel::DEBUG, msg)
+
+// Per sentence tracing is compiled out of release builds unless
+// TCPSENDER_TRACE is defined. sizeof keeps msg unevaluated but referenced.
+#if !defined(NDEBUG) || defined(TCPSENDER_TRACE)
+#define LOG_TRACE(msg) LOG_AT(LogLevel::TRACE, msg)
+#else
+#define LOG_TRACE(msg) do { (void) sizeof(msg); } while (0)
+#endif
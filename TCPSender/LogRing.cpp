@@ -0,0 +1,48 @@
+#include "LogRing.h"
+
+using std::lock_guard;
+using std::mutex;
+
+LogRing::LogRing(size_t capacity) : lines(capacity > 0 ? capacity : 1)
+{
+}
+
+bool LogRing::push(char const* line, size_t len)
+{
+	lock_guard<mutex> lk{mut};
+
+	if (count == lines.size()) {
+		head = (head + 1) % lines.size();
+		--count;
+		++dropped;
+	}
+
+	lines[(head + count) % lines.size()].assign(line, len);
+	++count;
+
+	bool wake = !signalled;
+	signalled = true;
+	return wake;
+}
+
+void LogRing::wake_failed()
+{
+	lock_guard<mutex> lk{mut};
+	signalled = false;
+}
+
+size_t LogRing::take(std::string& out)
+{
+	lock_guard<mutex> lk{mut};
+
+	for (; count > 0; --count) {
+		out.append(lines[head]);
+		out.append("\r\n");
+		head = (head + 1) % lines.size();
+	}
+
+	size_t n = dropped;
+	dropped = 0;
+	signalled = false;
+	return n;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Fixed capacity ring of log lines waiting to be shown in the dialog.
+ *
+ * Any thread may push. Slots keep their storage, so steady logging does not
+ * allocate. When full the oldest line is overwritten and counted as dropped.
+ * Only the first push after a take() asks for a wakeup, which coalesces
+ * bursts of lines into a single dialog update.
+ */
+class LogRing {
+public:
+	explicit LogRing(size_t capacity);
+
+	/**
+	 * Returns true if the reader has to be woken up to take the line
+	 */
+	bool push(char const* line, size_t len);
+
+	/**
+	 * Call if the wakeup asked for by push() could not be delivered, so the
+	 * next push asks again
+	 */
+	void wake_failed();
+
+	/**
+	 * Append all pending lines to out, each followed by "\r\n".
+	 * Returns the number of lines dropped since the last call.
+	 */
+	size_t take(std::string& out);
+
+private:
+	std::mutex mut;
+	std::vector<std::string> lines;
+	size_t head = 0;
+	size_t count = 0;
+	size_t dropped = 0;
+	bool signalled = false;
+};
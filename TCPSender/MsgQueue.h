@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * What to do when pushing into a full queue
+ */
+enum class DropPolicy {
+	OLDEST, // Evict the oldest queued element to make room
+	NEWEST  // Reject the element being pushed
+};
+
+/**
+ * Bounded lock-free queue with preallocated slots (Vyukov's array queue).
+ *
+ * Any number of threads may push. Popping is meant for a single consumer but
+ * is safe from multiple threads, which producers rely on to evict the oldest
+ * element on overflow.
+ *
+ * Slots are never destroyed while the queue lives. Producers write into the
+ * slot in place and the consumer swaps its contents out, so element types
+ * that keep their storage (e.g. strings) stop allocating once warmed up.
+ */
+template <typename T>
+class MsgQueue {
+public:
+	// Capacity is rounded up to the next power of two
+	explicit MsgQueue(size_t capacity)
+	{
+		size_t cap = 2;
+		while (cap < capacity)
+			cap <<= 1;
+
+		mask = cap - 1;
+		limit.store(cap, std::memory_order_relaxed);
+		cells.reset(new Cell[cap]);
+		for (size_t i = 0; i < cap; ++i)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	MsgQueue(MsgQueue const&) = delete;
+	MsgQueue& operator=(MsgQueue const&) = delete;
+
+	/**
+	 * Claim a slot and call fill(T&) on it. Returns false if the element
+	 * was dropped because the queue is full and policy is NEWEST.
+	 */
+	template <typename F>
+	bool push(F&& fill, DropPolicy policy)
+	{
+		size_t pos;
+		Cell* cell;
+
+		for (;;) {
+			if (size() < limit.load(std::memory_order_relaxed)
+					&& claim(enq_pos, 0, pos, cell))
+				break;
+
+			if (policy == DropPolicy::NEWEST) {
+				n_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			if (discard())
+				n_dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		fill(cell->data);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Swap the oldest element into out. Returns false if nothing is ready.
+	 */
+	bool pop(T& out)
+	{
+		size_t pos;
+		Cell* cell;
+
+		if (!claim(deq_pos, 1, pos, cell))
+			return false;
+
+		using std::swap;
+		swap(out, cell->data);
+		cell->seq.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * True if no element is ready to be popped
+	 */
+	bool empty() const
+	{
+		size_t pos = deq_pos.load(std::memory_order_relaxed);
+		size_t seq = cells[pos & mask].seq.load(std::memory_order_acquire);
+		return seq != pos + 1;
+	}
+
+	size_t capacity() const { return mask + 1; }
+
+	/**
+	 * Treat the queue as full once it holds n elements, 1 to capacity().
+	 * Lets the length be configured without reallocating slots that
+	 * producers may be writing to. Applies to pushes starting afterwards.
+	 */
+	void set_limit(size_t n)
+	{
+		limit.store(std::min(std::max(n, (size_t) 1), capacity()),
+			std::memory_order_relaxed);
+	}
+
+	/**
+	 * Number of queued elements, approximate while others push or pop
+	 */
+	size_t size() const
+	{
+		size_t deq = deq_pos.load(std::memory_order_relaxed);
+		size_t enq = enq_pos.load(std::memory_order_relaxed);
+		size_t n = enq - deq;
+		return (intptr_t) n < 0 ? 0 : std::min(n, capacity());
+	}
+
+	/**
+	 * Number of elements lost to overflow since construction
+	 */
+	uint64_t dropped() const
+	{
+		return n_dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	/**
+	 * Advance ctr if the cell it points at has the sequence number expected
+	 * for this side (offset 0 for producers, 1 for consumers)
+	 */
+	bool claim(std::atomic<size_t>& ctr, size_t offset, size_t& pos, Cell*& cell)
+	{
+		pos = ctr.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells[pos & mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + offset);
+
+			if (diff == 0) {
+				if (ctr.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					return true;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = ctr.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Drop the oldest element. It is released right away rather than left
+	 * in its slot, which may not be reused for a while if a limit is set,
+	 * so e.g. pooled buffers go back to their pool.
+	 */
+	bool discard()
+	{
+		size_t pos;
+		Cell* cell;
+
+		if (!claim(deq_pos, 1, pos, cell))
+			return false;
+
+		cell->data = T{};
+		cell->seq.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	std::atomic<size_t> limit;
+
+	// Keep the hot counters on separate cache lines
+	alignas(64) std::atomic<size_t> enq_pos{0};
+	alignas(64) std::atomic<size_t> deq_pos{0};
+	alignas(64) std::atomic<uint64_t> n_dropped{0};
+};
@@ -0,0 +1,253 @@
+#include "Net.h"
+#include "Log.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::wstring;
+using clk = std::chrono::steady_clock;
+
+#define DEFAULT_PORT "30501"
+
+DnsCache::~DnsCache()
+{
+	detach();
+	if (worker.joinable())
+		worker.join();
+	if (found != NULL)
+		freeaddrinfo(found);
+	clear();
+}
+
+void DnsCache::clear()
+{
+	if (result != NULL)
+		freeaddrinfo(result);
+	result = NULL;
+	key.clear();
+}
+
+void DnsCache::detach()
+{
+	std::lock_guard<std::mutex> lk{mut};
+	waker = nullptr;
+}
+
+DnsStatus DnsCache::resolve(wstring const& remote, unsigned ttl_ms,
+	Reactor& reactor)
+{
+	clk::time_point now = clk::now();
+
+	if (stale.exchange(false))
+		expires = now;
+
+	if (lookup_running) {
+		if (!lookup_done.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lk{mut};
+			waker = &reactor;
+			return DnsStatus::PENDING;
+		}
+
+		// Answers the caller even if it is out of date already, e.g.
+		// with a TTL of 0
+		finish_lookup(now);
+		if (remote == key)
+			return result != NULL ? DnsStatus::RESOLVED : DnsStatus::FAILED;
+	}
+
+	if (remote == key && now < expires) {
+		n_hits.fetch_add(1, std::memory_order_relaxed);
+		return result != NULL ? DnsStatus::RESOLVED : DnsStatus::FAILED;
+	}
+
+	n_misses.fetch_add(1, std::memory_order_relaxed);
+	start_lookup(remote, ttl_ms, reactor);
+	return DnsStatus::PENDING;
+}
+
+void DnsCache::start_lookup(wstring const& remote, unsigned ttl_ms,
+	Reactor& reactor)
+{
+	string remote_ch = to_utf8(remote);
+	string::size_type pos = remote_ch.rfind(":");
+	string host = remote_ch.substr(0, pos);
+	string port = pos == string::npos ? DEFAULT_PORT : remote_ch.substr(pos + 1);
+
+	lookup_key = remote;
+	lookup_ttl_ms = ttl_ms;
+	lookup_running = true;
+	lookup_done.store(false, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lk{mut};
+		waker = &reactor;
+	}
+
+	worker = std::thread{[this, host, port] {
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* res = NULL;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+			res = NULL;
+
+		std::lock_guard<std::mutex> lk{mut};
+		found = res;
+		lookup_done.store(true, std::memory_order_release);
+		if (waker != nullptr)
+			waker->wake();
+	}};
+}
+
+void DnsCache::finish_lookup(clk::time_point now)
+{
+	worker.join();
+	lookup_running = false;
+
+	clear();
+	{
+		std::lock_guard<std::mutex> lk{mut};
+		result = found;
+		found = NULL;
+	}
+	key = lookup_key;
+
+	unsigned ttl_ms = result != NULL ? lookup_ttl_ms
+		: std::min(lookup_ttl_ms, (unsigned) DNS_NEGATIVE_TTL_MS);
+	expires = now + std::chrono::milliseconds{ttl_ms};
+}
+
+/**
+ * Order addresses alternating between families, starting with the family
+ * the resolver preferred
+ */
+static vector<addrinfo const*> interleave(addrinfo const* list)
+{
+	vector<addrinfo const*> first, other;
+	for (addrinfo const* ai = list; ai != NULL; ai = ai->ai_next)
+		(ai->ai_family == list->ai_family ? first : other).push_back(ai);
+
+	vector<addrinfo const*> res;
+	for (size_t i = 0; i < first.size() || i < other.size(); ++i) {
+		if (i < first.size())
+			res.push_back(first[i]);
+		if (i < other.size())
+			res.push_back(other[i]);
+	}
+	return res;
+}
+
+/**
+ * Create a non-blocking socket and start connecting it
+ */
+static SOCKET start_connect(addrinfo const* ai)
+{
+	SOCKET sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (sock == INVALID_SOCKET)
+		return sock;
+
+	if (!set_nonblocking(sock, true)) {
+		close_socket(sock);
+		return INVALID_SOCKET;
+	}
+
+	// Writes are batches already, holding them back only adds latency
+	set_nodelay(sock);
+
+	if (connect(sock, ai->ai_addr, (int) ai->ai_addrlen) == SOCKET_ERROR
+			&& !socket_connect_pending()) {
+		close_socket(sock);
+		return INVALID_SOCKET;
+	}
+
+	return sock;
+}
+
+void Connector::start(addrinfo const* list, unsigned stagger_ms,
+	unsigned timeout_ms)
+{
+	cancel();
+	addrs = interleave(list);
+	next = 0;
+	next_start = clk::now();
+	stagger = std::chrono::milliseconds{stagger_ms};
+	timeout = std::chrono::milliseconds{timeout_ms};
+}
+
+SOCKET Connector::step(Reactor& reactor, clk::time_point now,
+	clk::time_point& deadline)
+{
+	// Attempts that finished during the last wait. Winsock reports failed
+	// connects in the except set, elsewhere they become writable.
+	for (size_t i = 0; i < pending.size(); ) {
+		SOCKET sock = pending[i].sock;
+		unsigned events = reactor.ready(sock);
+		if (!(events & (REACTOR_WRITE | REACTOR_ERROR))) {
+			++i;
+			continue;
+		}
+
+		int err = 0;
+		socklen_t err_len = sizeof(err);
+		bool failed = (events & REACTOR_ERROR)
+			|| getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*) &err,
+				&err_len) == SOCKET_ERROR
+			|| err != 0;
+
+		pending.erase(pending.begin() + i);
+		if (!failed) {
+			cancel();
+			return sock;
+		}
+
+		LOG_DEBUG("Connection attempt failed");
+		close_socket(sock);
+		next_start = now;
+	}
+
+	// Give up on attempts that took too long
+	for (size_t i = 0; i < pending.size(); ) {
+		if (now - pending[i].started >= timeout) {
+			LOG_DEBUG("Connection attempt timed out");
+			close_socket(pending[i].sock);
+			pending.erase(pending.begin() + i);
+			next_start = now;
+		} else {
+			++i;
+		}
+	}
+
+	// Start the next attempt when due or when nothing else is running
+	while (next < addrs.size() && pending.size() < FD_SETSIZE
+			&& (pending.empty() || now >= next_start)) {
+		SOCKET sock = start_connect(addrs[next++]);
+		if (sock != INVALID_SOCKET)
+			pending.push_back({sock, now});
+		next_start = now + stagger;
+	}
+
+	for (Attempt const& a : pending) {
+		reactor.watch(a.sock, REACTOR_WRITE);
+		deadline = std::min(deadline, a.started + timeout);
+	}
+	if (next < addrs.size())
+		deadline = std::min(deadline, next_start);
+
+	return INVALID_SOCKET;
+}
+
+void Connector::cancel()
+{
+	for (Attempt const& a : pending)
+		close_socket(a.sock);
+	pending.clear();
+	addrs.clear();
+	next = 0;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Reactor.h"
+#include "Socket.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DNS_NEGATIVE_TTL_MS 5000
+
+enum class DnsStatus {
+	PENDING,
+	RESOLVED,
+	FAILED
+};
+
+/**
+ * Resolved addresses of the last remote ("host:port") looked up, kept for a
+ * TTL so reconnect attempts do not hit the resolver every time. Failed
+ * lookups are kept for DNS_NEGATIVE_TTL_MS at most.
+ *
+ * The resolver blocks, so lookups run on a worker thread that wakes the
+ * reactor once done. resolve() and everything else is meant for the
+ * thread owning the reactor, invalidate() may be called from any thread.
+ * The destructor waits for a running lookup.
+ */
+class DnsCache {
+public:
+	DnsCache() = default;
+	~DnsCache();
+
+	DnsCache(DnsCache const&) = delete;
+	DnsCache& operator=(DnsCache const&) = delete;
+
+	/**
+	 * Answer from the cache or start looking up remote. Returns PENDING
+	 * while the lookup runs, call again after reactor was woken. A ttl_ms
+	 * of 0 disables caching.
+	 */
+	DnsStatus resolve(std::wstring const& remote, unsigned ttl_ms,
+		Reactor& reactor);
+
+	/**
+	 * Addresses of the last RESOLVED answer, valid until the next call of
+	 * resolve()
+	 */
+	addrinfo const* addresses() const { return result; }
+
+	/**
+	 * True once a running lookup finished and resolve() will return its
+	 * answer
+	 */
+	bool done() const
+	{
+		return lookup_running && lookup_done.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Stop waking the reactor, e.g. before it goes away. The next
+	 * resolve() picks up the lookup again.
+	 */
+	void detach();
+
+	/**
+	 * Force the next resolve() to query the resolver again
+	 */
+	void invalidate() { stale = true; }
+
+	uint64_t hits() const { return n_hits.load(std::memory_order_relaxed); }
+	uint64_t misses() const { return n_misses.load(std::memory_order_relaxed); }
+
+private:
+	void start_lookup(std::wstring const& remote, unsigned ttl_ms,
+		Reactor& reactor);
+	void finish_lookup(std::chrono::steady_clock::time_point now);
+	void clear();
+
+	// Cached answer, result is NULL if the lookup failed
+	std::wstring key;
+	addrinfo* result = NULL;
+	std::chrono::steady_clock::time_point expires;
+	std::atomic<bool> stale{false};
+	std::atomic<uint64_t> n_hits{0};
+	std::atomic<uint64_t> n_misses{0};
+
+	// Lookup on the worker. mut protects found and waker.
+	std::thread worker;
+	std::wstring lookup_key;
+	unsigned lookup_ttl_ms = 0;
+	bool lookup_running = false;
+	std::atomic<bool> lookup_done{false};
+	std::mutex mut;
+	addrinfo* found = NULL;
+	Reactor* waker = nullptr;
+};
+
+/**
+ * Non-blocking connection to one of the addresses in list, Happy Eyeballs
+ * style (RFC 8305), driven by a Reactor.
+ *
+ * Addresses are tried alternating between families. A new attempt starts
+ * every stagger_ms, or immediately when one fails, while earlier attempts
+ * keep running. Attempts are abandoned after timeout_ms. The first socket
+ * to connect wins and the others are closed.
+ */
+class Connector {
+public:
+	using clock = std::chrono::steady_clock;
+
+	Connector() = default;
+	~Connector() { cancel(); }
+
+	Connector(Connector const&) = delete;
+	Connector& operator=(Connector const&) = delete;
+
+	/**
+	 * Begin connecting. list has to stay valid until the connector is done.
+	 */
+	void start(addrinfo const* list, unsigned stagger_ms, unsigned timeout_ms);
+
+	/**
+	 * Collect the results of the last reactor wait, start due attempts and
+	 * watch the pending ones. deadline is lowered to when step has to run
+	 * again at the latest.
+	 * Returns the connected non-blocking socket, otherwise INVALID_SOCKET.
+	 */
+	SOCKET step(Reactor& reactor, clock::time_point now,
+		clock::time_point& deadline);
+
+	/**
+	 * True once every address failed
+	 */
+	bool failed() const { return next >= addrs.size() && pending.empty(); }
+
+	/**
+	 * Close all pending attempts
+	 */
+	void cancel();
+
+private:
+	struct Attempt {
+		SOCKET sock;
+		clock::time_point started;
+	};
+
+	std::vector<addrinfo const*> addrs;
+	std::vector<Attempt> pending;
+	size_t next = 0;
+	clock::time_point next_start;
+	std::chrono::milliseconds stagger{0};
+	std::chrono::milliseconds timeout{0};
+};
@@ -0,0 +1,126 @@
+#include "Reactor.h"
+
+#include <algorithm>
+#include <cstring>
+
+Reactor::~Reactor()
+{
+	if (wake_sock != INVALID_SOCKET)
+		close_socket(wake_sock);
+}
+
+bool Reactor::open()
+{
+	FD_ZERO(&rd_ready);
+	FD_ZERO(&wr_ready);
+	FD_ZERO(&ex_ready);
+
+	// A UDP socket connected to itself works as wakeup pipe everywhere,
+	// Winsock cannot select on pipes
+	SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_SOCKET)
+		return false;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+
+	if (bind(sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| getsockname(sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+			|| connect(sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| !set_nonblocking(sock, true)) {
+		close_socket(sock);
+		return false;
+	}
+
+	wake_sock = sock;
+	is_open.store(true, std::memory_order_release);
+	return true;
+}
+
+void Reactor::watch(SOCKET sock, unsigned events)
+{
+	watched.push_back({sock, events});
+}
+
+unsigned Reactor::ready(SOCKET sock) const
+{
+	if (sock == INVALID_SOCKET)
+		return 0;
+
+	unsigned events = 0;
+	if (FD_ISSET(sock, &rd_ready))
+		events |= REACTOR_READ;
+	if (FD_ISSET(sock, &wr_ready))
+		events |= REACTOR_WRITE;
+	if (FD_ISSET(sock, &ex_ready))
+		events |= REACTOR_ERROR;
+	return events;
+}
+
+void Reactor::prepare_sleep()
+{
+	// Pairs with the fence in wake(): either the waker sees sleeping or
+	// the owner sees the work queued before the wake
+	sleeping.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool Reactor::wait(clock::time_point deadline)
+{
+	FD_ZERO(&rd_ready);
+	FD_ZERO(&wr_ready);
+	FD_ZERO(&ex_ready);
+
+	FD_SET(wake_sock, &rd_ready);
+	SOCKET max_sock = wake_sock;
+
+	for (Watch const& w : watched) {
+		if (w.events & REACTOR_READ)
+			FD_SET(w.sock, &rd_ready);
+		if (w.events & REACTOR_WRITE) {
+			FD_SET(w.sock, &wr_ready);
+			FD_SET(w.sock, &ex_ready);
+		}
+		max_sock = std::max(max_sock, w.sock);
+	}
+	watched.clear();
+
+	timeval tv;
+	timeval* tvp = NULL;
+	if (deadline != clock::time_point::max()) {
+		auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::max(deadline - clock::now(), clock::duration::zero()));
+		tv.tv_sec = (long) (wait.count() / 1000000);
+		tv.tv_usec = (long) (wait.count() % 1000000);
+		tvp = &tv;
+	}
+
+	int res = select((int) max_sock + 1, &rd_ready, &wr_ready, &ex_ready, tvp);
+	sleeping.store(false, std::memory_order_relaxed);
+
+	if (res == SOCKET_ERROR) {
+		FD_ZERO(&rd_ready);
+		FD_ZERO(&wr_ready);
+		FD_ZERO(&ex_ready);
+		return false;
+	}
+
+	if (FD_ISSET(wake_sock, &rd_ready)) {
+		char buf[64];
+		while (recv(wake_sock, buf, sizeof(buf), 0) > 0)
+			;
+	}
+	return true;
+}
+
+void Reactor::wake()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.exchange(false, std::memory_order_relaxed)
+			&& is_open.load(std::memory_order_acquire))
+		send(wake_sock, "", 1, 0);
+}
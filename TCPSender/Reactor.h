@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#define REACTOR_READ 0x1
+#define REACTOR_WRITE 0x2
+#define REACTOR_ERROR 0x4
+
+/**
+ * select() based readiness loop for non-blocking sockets.
+ *
+ * Each iteration the owner registers the sockets it waits on with watch(),
+ * then calls wait(). Afterwards ready() tells what happened to each of
+ * them until the next wait(). Registrations only last for one wait.
+ *
+ * Other threads wake a waiting loop with wake(). The owner calls
+ * prepare_sleep() before checking for work, so a wake() between that
+ * check and wait() is not lost. Wakes while the loop is busy are free.
+ */
+class Reactor {
+public:
+	using clock = std::chrono::steady_clock;
+
+	Reactor() = default;
+	~Reactor();
+
+	Reactor(Reactor const&) = delete;
+	Reactor& operator=(Reactor const&) = delete;
+
+	/**
+	 * Create the wakeup socket. Returns false on failure.
+	 */
+	bool open();
+
+	void watch(SOCKET sock, unsigned events);
+
+	/**
+	 * Events of sock seen by the last wait(). Failed connects show up as
+	 * REACTOR_ERROR on some platforms and as writable on others.
+	 */
+	unsigned ready(SOCKET sock) const;
+
+	void prepare_sleep();
+
+	/**
+	 * Block until a watched socket is ready, wake() is called or deadline
+	 * passes. Returns false if select failed.
+	 */
+	bool wait(clock::time_point deadline);
+
+	/**
+	 * Interrupt wait(), callable from any thread
+	 */
+	void wake();
+
+private:
+	struct Watch {
+		SOCKET sock;
+		unsigned events;
+	};
+
+	std::vector<Watch> watched;
+	fd_set rd_ready, wr_ready, ex_ready;
+
+	// Published through is_open for wake() on other threads
+	SOCKET wake_sock = INVALID_SOCKET;
+	std::atomic<bool> is_open{false};
+	std::atomic<bool> sleeping{false};
+};
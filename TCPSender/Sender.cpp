@@ -0,0 +1,402 @@
+#include "Sender.h"
+#include "Log.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <fstream>
+#include <thread>
+
+using std::filesystem::path;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::unique_lock;
+using std::wstring;
+
+#define IO_ERROR_WAIT_MS 100
+
+Sender::Sender(std::function<void()> status_changed)
+	: status_changed(std::move(status_changed))
+{
+	for (Receiver& r : receivers)
+		r.link.set_trace(&trace);
+}
+
+void Sender::configure(Config const& cfg, path const& dir)
+{
+	auto list = split_list(cfg.remote);
+	if (list.size() > MAX_REMOTES) {
+		LOG_ERROR("Only the first " + std::to_string(MAX_REMOTES)
+			+ " remotes are used");
+		list.resize(MAX_REMOTES);
+	}
+
+	log_level = cfg.log_level;
+	std::atomic_store(&thread_filter, std::make_shared<ThreadFilter const>(
+		cfg.forward_all_threads, cfg.thread_allow, cfg.thread_deny));
+	dedup.configure(cfg.dedup_recent, cfg.collapse_repeats);
+	trace.enable(cfg.latency_trace);
+	for (Receiver& r : receivers)
+		r.queue.set_lane_limit(cfg.queue_capacity);
+
+	{
+		lock_guard<mutex> lk{mut};
+		config = cfg;
+		config_dir = dir;
+		for (size_t i = 0; i < MAX_REMOTES; ++i)
+			remotes[i] = i < list.size() ? list[i] : L"";
+		n_receivers = (unsigned) list.size();
+		configured = true;
+		++config_gen;
+	}
+
+	init_cv.notify_one();
+	reactor.wake();
+	status_changed();
+}
+
+ReceiverStatus Sender::status(unsigned i) const
+{
+	ReceiverStatus s;
+	if (i >= MAX_REMOTES)
+		return s;
+
+	Link const& link = receivers[i].link;
+	s.state = link.state();
+	s.retry_delay_ms = link.retry_delay_ms();
+	s.retry_attempt = link.retry_attempt();
+	return s;
+}
+
+uint64_t Sender::dropped() const
+{
+	uint64_t n = 0;
+	for (Receiver const& r : receivers)
+		n += r.queue.dropped();
+	return n;
+}
+
+size_t Sender::queue_depth(unsigned i) const
+{
+	return i < MAX_REMOTES ? receivers[i].queue.size() : 0;
+}
+
+uint64_t Sender::queue_dropped(unsigned i) const
+{
+	return i < MAX_REMOTES ? receivers[i].queue.dropped() : 0;
+}
+
+LinkStats const& Sender::link_stats(unsigned i) const
+{
+	return receivers[std::min(i, (unsigned) MAX_REMOTES - 1)].link.stats();
+}
+
+string Sender::metrics()
+{
+	wstring names[MAX_REMOTES];
+	unsigned n;
+	{
+		lock_guard<mutex> lk{mut};
+		for (size_t i = 0; i < MAX_REMOTES; ++i)
+			names[i] = remotes[i];
+		n = n_receivers;
+	}
+
+	string out;
+	append_metric(out, "tcpsender_sentences_submitted", "", submitted());
+	append_metric(out, "tcpsender_sentences_filtered", "", filtered());
+	append_metric(out, "tcpsender_sentences_duplicate", "", duplicates());
+	append_metric(out, "tcpsender_sentences_collapsed", "", dedup.collapsed());
+	append_metric(out, "tcpsender_frame_pool_misses", "", frame_pool.misses());
+
+	for (unsigned i = 0; i < n; ++i) {
+		LinkStats const& st = link_stats(i);
+		string labels = "receiver=\"" + std::to_string(i) + "\",remote=\""
+			+ to_utf8(names[i]) + "\"";
+
+		append_metric(out, "tcpsender_queue_depth", labels, queue_depth(i));
+		append_metric(out, "tcpsender_queue_dropped", labels, queue_dropped(i));
+		append_metric(out, "tcpsender_connects", labels,
+			LinkStats::get(st.connects));
+		append_metric(out, "tcpsender_connect_failures", labels,
+			LinkStats::get(st.connect_failures));
+		append_metric(out, "tcpsender_disconnects", labels,
+			LinkStats::get(st.disconnects));
+		append_metric(out, "tcpsender_sentences_sent", labels,
+			LinkStats::get(st.sentences_sent));
+		append_metric(out, "tcpsender_bytes_sent", labels,
+			LinkStats::get(st.bytes_sent));
+
+		HistogramCounts latency;
+		st.send_latency_us.read(latency);
+		append_histogram(out, "tcpsender_send_latency_us", labels, latency);
+	}
+
+	if (trace.enabled())
+		trace.append_metrics(out);
+	return out;
+}
+
+void Sender::log_trace() const
+{
+	if (!trace.enabled()) {
+		LOG_INFO("Latency tracing is off, enable it with LatencyTrace=1");
+		return;
+	}
+
+	LOG_INFO("Latency of each stage since tracing was enabled:");
+	for (size_t i = 0; i < (size_t) Stage::COUNT; ++i)
+		LOG_INFO(trace.summary((Stage) i));
+}
+
+/**
+ * Replace the metrics file, see Config::metrics_file. Readers see either
+ * the old or the new dump.
+ */
+bool Sender::write_metrics(path const& filepath)
+{
+	string dump = metrics();
+	path tmp = filepath;
+	tmp += L".tmp";
+
+	{
+		std::ofstream f{tmp, std::ios_base::binary | std::ios_base::trunc};
+		f.write(dump.data(), (std::streamsize) dump.size());
+		if (!f.good())
+			return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp, filepath, ec);
+	return !ec;
+}
+
+/**
+ * Open the spill log of each configured receiver, see Config::spill_file,
+ * and close those of receivers that are gone. Receivers after the first
+ * spill to numbered files. Called by the I/O loop for each new config.
+ */
+void Sender::open_spill_files(Config const& cfg, path const& dir, unsigned n)
+{
+	for (unsigned i = 0; i < MAX_REMOTES; ++i) {
+		Receiver& r = receivers[i];
+
+		wstring want;
+		if (i < n && !cfg.spill_file.empty()) {
+			path spill_path = dir / cfg.spill_file;
+			if (i > 0)
+				spill_path += L"." + std::to_wstring(i);
+			want = spill_path.wstring();
+		}
+
+		if (want == r.spill_path && cfg.spill_max_bytes == r.spill_max_bytes)
+			continue;
+
+		r.link.close_spill();
+		r.spill_path.clear();
+		if (want.empty())
+			continue;
+
+		if (r.link.open_spill(want, cfg.spill_max_bytes)) {
+			r.spill_path = want;
+			r.spill_max_bytes = cfg.spill_max_bytes;
+			LOG_INFO("Spilling to " + to_utf8(want) + ", "
+				+ std::to_string(r.link.spill_size()) + " bytes pending");
+		} else {
+			LOG_ERROR("Could not open spill file " + to_utf8(want));
+		}
+	}
+}
+
+/**
+ * Drive the connections of all receivers from one thread. Sockets are
+ * non-blocking, the loop only sleeps in the reactor until a socket is
+ * ready, a deadline of some link passes or it is woken.
+ */
+bool Sender::run()
+{
+	LOG_INFO("Starting I/O loop");
+
+	if (!reactor.open()) {
+		LOG_ERROR("Could not create wakeup socket. Exit");
+		return false;
+	}
+
+	// Copies taken under mut, the links only ever see these
+	Config cfg;
+	path dir;
+	wstring remote_copy[MAX_REMOTES];
+	unsigned n = 0;
+	unsigned seen_gen;
+
+	auto next_metrics = Reactor::clock::time_point::min();
+	bool metrics_failed = false;
+
+	{
+		unique_lock<mutex> lk{mut};
+		init_cv.wait(lk, [&] { return configured || !running; });
+		seen_gen = config_gen - 1;
+	}
+
+	while (running) {
+		unsigned gen = config_gen;
+		if (gen != seen_gen) {
+			lock_guard<mutex> lk{mut};
+			cfg = config;
+			dir = config_dir;
+			n = n_receivers;
+			for (size_t i = 0; i < MAX_REMOTES; ++i) {
+				remote_copy[i] = remotes[i];
+				receivers[i].link.invalidate_dns();
+			}
+			seen_gen = gen;
+			metrics_failed = false;
+
+			open_spill_files(cfg, dir, n);
+		}
+
+		auto now = Reactor::clock::now();
+		auto deadline = Reactor::clock::time_point::max();
+		bool changed = false;
+
+		for (size_t i = 0; i < MAX_REMOTES; ++i) {
+			Receiver& r = receivers[i];
+			deadline = std::min(deadline, r.link.step(reactor, now, cfg,
+				remote_copy[i], cfg.connect && i < n, r.queue));
+			changed |= r.link.take_state_changed();
+		}
+		if (changed)
+			status_changed();
+
+		if (!cfg.metrics_file.empty()) {
+			if (now >= next_metrics) {
+				if (!write_metrics(dir / cfg.metrics_file) && !metrics_failed) {
+					LOG_ERROR("Could not write metrics file "
+						+ (dir / cfg.metrics_file).u8string());
+					metrics_failed = true;
+				}
+				next_metrics = now + std::chrono::milliseconds{
+					std::max(cfg.metrics_interval_ms, 1u)};
+			}
+			deadline = std::min(deadline, next_metrics);
+		}
+
+		// Don't sleep on work that arrived while stepping, wakes from here
+		// on interrupt the wait
+		reactor.prepare_sleep();
+		bool busy = config_gen != seen_gen || !running;
+		for (Receiver const& r : receivers)
+			busy = busy || (r.link.takes_input() && !r.queue.empty())
+				|| r.link.resolved();
+		if (busy)
+			deadline = now;
+
+		if (!reactor.wait(deadline)) {
+			LOG_ERROR("Waiting for sockets failed");
+			std::this_thread::sleep_for(
+				std::chrono::milliseconds{IO_ERROR_WAIT_MS});
+		}
+	}
+
+	// Close all connections
+	auto now = Reactor::clock::now();
+	for (size_t i = 0; i < MAX_REMOTES; ++i) {
+		Receiver& r = receivers[i];
+		r.link.step(reactor, now, cfg, remote_copy[i], false, r.queue);
+	}
+
+	LOG_INFO("I/O cleanup and exit");
+	LOG_DEBUG("Frame pool hits " + std::to_string(frame_pool.hits())
+		+ ", misses " + std::to_string(frame_pool.misses())
+		+ ", peak bytes " + std::to_string(frame_pool.peak_bytes()));
+	LOG_DEBUG("Duplicates dropped " + std::to_string(dedup.hits())
+		+ ", sentences collapsed " + std::to_string(dedup.collapsed()));
+
+	return true;
+}
+
+void Sender::stop()
+{
+	{
+		lock_guard<mutex> lk{mut};
+		running = false;
+	}
+	init_cv.notify_one();
+	reactor.wake();
+}
+
+void Sender::submit(wchar_t const* sentence, bool selected,
+	wchar_t const* thread_name, uint32_t text_number, uint32_t process_id)
+{
+	uint64_t entry_ns = trace.enabled() ? StageTrace::now_ns() : 0;
+	n_submitted.fetch_add(1, std::memory_order_relaxed);
+
+	if (!selected) {
+		auto filter = std::atomic_load(&thread_filter);
+		if (!filter->forwards_unselected()
+				|| !filter->accept(false, thread_name)) {
+			n_filtered.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	LOG_TRACE("Received sentence");
+
+	SentenceMeta meta;
+	meta.timestamp_us = (uint64_t) std::chrono::duration_cast<
+		std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	meta.text_number = text_number;
+	meta.process_id = process_id;
+
+	// Collapsed sentences keep every stride-th code unit, one per run of
+	// repeated characters, or are cut to their first repetition
+	size_t full_len = wcslen(sentence);
+	size_t len = full_len;
+	size_t stride = 1;
+	unsigned collapse = dedup.collapse_flags();
+	if (collapse & COLLAPSE_CHARS)
+		stride = repeat_factor(sentence, full_len);
+	if (stride == 1 && (collapse & COLLAPSE_TEXT))
+		len = repeat_period(sentence, full_len);
+
+	if (dedup.enabled() && dedup.seen(
+			sentence_hash(sentence, len, stride, meta.text_number))) {
+		LOG_TRACE("Dropping duplicate sentence");
+		return;
+	}
+	if (len < full_len || stride > 1)
+		dedup.count_collapsed();
+
+	unsigned n = n_receivers;
+	if (n == 0)
+		return;
+
+	// Encode once straight from the caller's buffer into a pooled buffer,
+	// each receiver queues a reference
+	FrameBuf text = frame_pool.acquire(utf8_max_len(len / stride));
+	text.set_size(collapse_to_utf8(sentence, len, stride, text.data()));
+
+	uint64_t converted_ns = 0;
+	if (entry_ns != 0) {
+		converted_ns = StageTrace::now_ns();
+		trace.record(Stage::CONVERT, entry_ns, converted_ns);
+	}
+
+	size_t lane = selected ? 0 : 1 + meta.text_number % (MSG_Q_LANES - 1);
+	for (unsigned i = 0; i < n; ++i) {
+		receivers[i].queue.push(lane, [&](Sentence& slot) {
+			slot.text = text.share();
+			slot.meta = meta;
+			slot.entry_ns = entry_ns;
+			slot.enqueued_ns = 0;
+			if (entry_ns != 0) {
+				slot.enqueued_ns = StageTrace::now_ns();
+				trace.record(Stage::ENQUEUE, converted_ns, slot.enqueued_ns);
+			}
+		}, MSG_Q_DROP_POLICY);
+	}
+	reactor.wake();
+}
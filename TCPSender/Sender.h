@@ -0,0 +1,172 @@
+#pragma once
+
+#include "Config.h"
+#include "Dedup.h"
+#include "FramePool.h"
+#include "LaneQueue.h"
+#include "Link.h"
+#include "MsgQueue.h"
+#include "Reactor.h"
+#include "Stats.h"
+#include "ThreadFilter.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Slots allocated per lane, Config::queue_capacity limits how many are used
+#define MSG_Q_CAP 256
+#define MSG_Q_LANES 4
+#define MAX_REMOTES 4
+#define MSG_Q_DROP_POLICY DropPolicy::OLDEST
+
+/**
+ * Connection status of one receiver as shown to the user
+ */
+struct ReceiverStatus {
+	ConnState state = ConnState::DISCONNECTED;
+	unsigned retry_delay_ms = 0;
+	unsigned retry_attempt = 0;
+};
+
+/**
+ * Platform independent core of the extension. Sentences are filtered and
+ * encoded on the submitting thread and queued for every receiver, one I/O
+ * thread sends them.
+ *
+ * The platform adapter runs run() on a thread of its own, feeds sentences
+ * to submit() and hands over settings with configure(). It also provides
+ * log(), see Log.h.
+ */
+class Sender {
+public:
+	/**
+	 * status_changed is called whenever the number of receivers or the
+	 * status of one changes, from the I/O thread or configure()
+	 */
+	explicit Sender(std::function<void()> status_changed);
+
+	Sender(Sender const&) = delete;
+	Sender& operator=(Sender const&) = delete;
+
+	/**
+	 * Apply cfg, callable from any thread. Receivers are connected while
+	 * cfg.connect is set. Relative paths in cfg are resolved against dir.
+	 */
+	void configure(Config const& cfg, std::filesystem::path const& dir);
+
+	/**
+	 * Run the I/O loop until stop(). Waits for the first configure() before
+	 * opening spill files or connecting. Sockets must be usable on the
+	 * calling thread, i.e. after WSAStartup on Windows.
+	 * Returns false if the loop could not start.
+	 */
+	bool run();
+
+	void stop();
+
+	/**
+	 * Queue sentence for all receivers. Never blocks and may be called from
+	 * any number of threads. selected tells whether it comes from the text
+	 * thread selected by the user, thread_name may be NULL.
+	 */
+	void submit(wchar_t const* sentence, bool selected,
+		wchar_t const* thread_name, uint32_t text_number, uint32_t process_id);
+
+	unsigned receiver_count() const { return n_receivers; }
+	ReceiverStatus status(unsigned i) const;
+
+	/**
+	 * Sentences lost to queue overflow, summed over all receivers
+	 */
+	uint64_t dropped() const;
+
+	// Counters for display, cheap to read from any thread
+	uint64_t submitted() const { return n_submitted.load(std::memory_order_relaxed); }
+	uint64_t filtered() const { return n_filtered.load(std::memory_order_relaxed); }
+	uint64_t duplicates() const { return dedup.hits(); }
+	size_t queue_depth(unsigned i) const;
+	uint64_t queue_dropped(unsigned i) const;
+	LinkStats const& link_stats(unsigned i) const;
+
+	/**
+	 * All counters as plain text, one "name{labels} value" line each.
+	 * Includes the stage latencies while tracing.
+	 */
+	std::string metrics();
+
+	/**
+	 * Stage latencies, see Config::latency_trace
+	 */
+	StageTrace const& stage_trace() const { return trace; }
+
+	/**
+	 * Write the stage latencies to the log
+	 */
+	void log_trace() const;
+
+private:
+	/**
+	 * One remote with its own queue, connection and backoff, so a slow or
+	 * unreachable receiver only loses its own sentences. Sentences are
+	 * encoded once and every receiver queues a reference.
+	 */
+	struct Receiver {
+		// Lock-free. Lane 0 holds the selected thread, others are spread
+		// over the rest.
+		LaneQueue<Sentence> queue{MSG_Q_LANES, MSG_Q_CAP};
+
+		// Driven by the I/O loop
+		Link link;
+
+		// Spill log the link has open, empty if none. Owned by the I/O loop.
+		std::wstring spill_path;
+		unsigned spill_max_bytes = 0;
+	};
+
+	void open_spill_files(Config const& cfg, std::filesystem::path const& dir,
+		unsigned n);
+	bool write_metrics(std::filesystem::path const& filepath);
+
+	std::function<void()> status_changed;
+
+	// Declared before the receivers so it outlives the buffers left in
+	// their queues
+	FramePool frame_pool;
+
+	// The first n_receivers have a remote
+	Receiver receivers[MAX_REMOTES];
+	std::atomic<unsigned> n_receivers{0};
+
+	// Read by the submitting threads without locking, swapped by configure
+	std::shared_ptr<ThreadFilter const> thread_filter =
+		std::make_shared<ThreadFilter const>();
+	Dedup dedup;
+
+	// Sentences handed to submit and those rejected by the thread filter
+	std::atomic<uint64_t> n_submitted{0};
+	std::atomic<uint64_t> n_filtered{0};
+
+	// Shared by submit and all links
+	StageTrace trace;
+
+	// Mutex protects the following vars, the I/O loop takes a copy when it
+	// sees a new config_gen
+	std::mutex mut;
+	std::condition_variable init_cv;
+	Config config;
+	std::filesystem::path config_dir;
+	std::wstring remotes[MAX_REMOTES];
+	bool configured = false;
+	std::atomic<unsigned> config_gen{0};
+
+	// Waits for all sockets of the I/O loop, woken by submit and configure
+	Reactor reactor;
+	std::atomic<bool> running{true};
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Extension.h"
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+/**
+ * SentenceInfo keys used by the extension
+ */
+enum class InfoKey {
+	CURRENT_SELECT,
+	TEXT_NUMBER,
+	PROCESS_ID,
+	TEXT_NAME,
+	COUNT
+};
+
+// FNV-1a, usable at compile time for the case labels below
+constexpr uint32_t info_key_hash(char const* s)
+{
+	uint32_t h = 2166136261u;
+	for (; *s; ++s)
+		h = (h ^ (unsigned char) *s) * 16777619u;
+	return h;
+}
+
+/**
+ * Values of all InfoKeys, collected in a single pass over the info array
+ * of a SentenceInfo. Unlike SentenceInfo::operator[] a missing key is not
+ * fatal, its value is just empty.
+ */
+class SentenceFields {
+public:
+	explicit SentenceFields(SentenceInfo const& info)
+	{
+		for (auto it = info.infoArray; it && it->name; ++it) {
+			InfoKey key;
+			char const* name;
+
+			switch (info_key_hash(it->name)) {
+			case info_key_hash("current select"):
+				key = InfoKey::CURRENT_SELECT;
+				name = "current select";
+				break;
+			case info_key_hash("text number"):
+				key = InfoKey::TEXT_NUMBER;
+				name = "text number";
+				break;
+			case info_key_hash("process id"):
+				key = InfoKey::PROCESS_ID;
+				name = "process id";
+				break;
+			case info_key_hash("text name"):
+				key = InfoKey::TEXT_NAME;
+				name = "text name";
+				break;
+			default:
+				continue;
+			}
+
+			// Guard against hash collisions with unrelated keys
+			if (std::strcmp(it->name, name) != 0)
+				continue;
+
+			values[(int) key] = it->value;
+			found |= 1u << (int) key;
+		}
+	}
+
+	std::optional<int64_t> get(InfoKey key) const
+	{
+		if (!(found & (1u << (int) key)))
+			return std::nullopt;
+		return values[(int) key];
+	}
+
+	/**
+	 * Value of key or def if it is missing
+	 */
+	int64_t get_or(InfoKey key, int64_t def) const
+	{
+		return get(key).value_or(def);
+	}
+
+private:
+	int64_t values[(int) InfoKey::COUNT];
+	uint32_t found = 0;
+};
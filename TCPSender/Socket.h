@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ * Minimal socket portability layer: Winsock names are used throughout,
+ * POSIX systems get equivalents here.
+ */
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#endif
+
+inline void close_socket(SOCKET sock)
+{
+#ifdef _WIN32
+	closesocket(sock);
+#else
+	close(sock);
+#endif
+}
+
+inline bool set_nonblocking(SOCKET sock, bool on)
+{
+#ifdef _WIN32
+	u_long mode = on ? 1 : 0;
+	return ioctlsocket(sock, FIONBIO, &mode) != SOCKET_ERROR;
+#else
+	int flags = fcntl(sock, F_GETFL, 0);
+	if (flags == -1)
+		return false;
+	flags = on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+	return fcntl(sock, F_SETFL, flags) != -1;
+#endif
+}
+
+/**
+ * Send small writes right away instead of coalescing them (Nagle)
+ */
+inline bool set_nodelay(SOCKET sock)
+{
+	int on = 1;
+	return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char const*) &on,
+		sizeof(on)) != SOCKET_ERROR;
+}
+
+/**
+ * True if the last socket call failed only because it would block
+ */
+inline bool socket_would_block()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/**
+ * True if the last connect() on a non-blocking socket is in progress
+ */
+inline bool socket_connect_pending()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EINPROGRESS;
+#endif
+}
+
+/**
+ * Non-blocking send/recv of raw bytes. Return the byte count, 0 if the call
+ * would block and -1 on errors. recv also returns -1 once the peer closed.
+ */
+inline long socket_send(SOCKET sock, char const* data, size_t len)
+{
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	flags = MSG_NOSIGNAL;
+#endif
+	int chunk = len > 0x40000000 ? 0x40000000 : (int) len;
+	long n = send(sock, data, chunk, flags);
+	if (n == SOCKET_ERROR)
+		return socket_would_block() ? 0 : -1;
+	return n;
+}
+
+inline long socket_recv(SOCKET sock, char* buf, size_t len)
+{
+	int chunk = len > 0x40000000 ? 0x40000000 : (int) len;
+	long n = recv(sock, buf, chunk, 0);
+	if (n == SOCKET_ERROR)
+		return socket_would_block() ? 0 : -1;
+	return n > 0 ? n : -1;
+}
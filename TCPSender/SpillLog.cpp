@@ -0,0 +1,206 @@
+#include "SpillLog.h"
+#include "Frame.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SPILL_MAGIC "TCPSPIL2"
+
+struct SpillLog::Header {
+	char magic[8];
+	uint64_t read_off;
+	uint64_t write_off;
+};
+
+SpillLog::~SpillLog()
+{
+	close();
+}
+
+bool SpillLog::open(std::wstring const& filepath, uint64_t capacity)
+{
+	close();
+	capacity = std::max(capacity, (uint64_t) sizeof(Header) + 4);
+
+	if (!map(filepath, capacity)) {
+		close();
+		return false;
+	}
+
+	// Start over on new or foreign files
+	Header* h = header();
+	if (memcmp(h->magic, SPILL_MAGIC, sizeof(h->magic)) != 0
+			|| h->read_off < sizeof(Header) || h->read_off > h->write_off
+			|| h->write_off > this->capacity) {
+		memcpy(h->magic, SPILL_MAGIC, sizeof(h->magic));
+		h->read_off = sizeof(Header);
+		h->write_off = sizeof(Header);
+	}
+
+	return true;
+}
+
+#ifdef _WIN32
+bool SpillLog::map(std::wstring const& filepath, uint64_t capacity)
+{
+	file = CreateFile(filepath.c_str(), GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Never shrink an existing log, it may hold more than capacity
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+		return false;
+	this->capacity = std::max(capacity, (uint64_t) size.QuadPart);
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READWRITE,
+		(DWORD) (this->capacity >> 32), (DWORD) this->capacity, NULL);
+	if (mapping == NULL)
+		return false;
+
+	view = (char*) MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+		(size_t) this->capacity);
+	return view != NULL;
+}
+
+void SpillLog::close()
+{
+	if (view != NULL)
+		UnmapViewOfFile(view);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	view = NULL;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+	capacity = 0;
+}
+#else
+bool SpillLog::map(std::wstring const& filepath, uint64_t capacity)
+{
+	fd = ::open(to_utf8(filepath).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return false;
+
+	// Never shrink an existing log, it may hold more than capacity
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return false;
+	this->capacity = std::max(capacity, (uint64_t) st.st_size);
+
+	// Unlike CreateFileMapping, mmap does not grow the file
+	if ((uint64_t) st.st_size < this->capacity
+			&& ftruncate(fd, (off_t) this->capacity) == -1)
+		return false;
+
+	void* p = mmap(NULL, (size_t) this->capacity, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return false;
+
+	view = (char*) p;
+	return true;
+}
+
+void SpillLog::close()
+{
+	if (view != NULL)
+		munmap(view, (size_t) capacity);
+	if (fd != -1)
+		::close(fd);
+
+	view = NULL;
+	fd = -1;
+	capacity = 0;
+}
+#endif
+
+bool SpillLog::empty() const
+{
+	return !is_open() || header()->read_off == header()->write_off;
+}
+
+uint64_t SpillLog::size() const
+{
+	return is_open() ? header()->write_off - header()->read_off : 0;
+}
+
+/**
+ * Move unacknowledged records to the start of the data area
+ */
+void SpillLog::compact()
+{
+	Header* h = header();
+	uint64_t len = h->write_off - h->read_off;
+
+	memmove(view + sizeof(Header), view + h->read_off, (size_t) len);
+	h->read_off = sizeof(Header);
+	h->write_off = sizeof(Header) + len;
+}
+
+bool SpillLog::push(char const* data, size_t len)
+{
+	if (!is_open())
+		return false;
+
+	Header* h = header();
+	uint64_t need = 4 + (uint64_t) len;
+
+	if (h->write_off + need > capacity && h->read_off > sizeof(Header))
+		compact();
+	if (h->write_off + need > capacity)
+		return false;
+
+	// The record is complete before write_off covers it, so a crash never
+	// exposes a half written record
+	put_le32(view + h->write_off, (uint32_t) len);
+	memcpy(view + h->write_off + 4, data, len);
+	h->write_off += need;
+
+	return true;
+}
+
+uint64_t SpillLog::begin() const
+{
+	return is_open() ? header()->read_off : 0;
+}
+
+bool SpillLog::read(uint64_t& pos, char const*& data, uint32_t& len) const
+{
+	if (!is_open() || pos + 4 > header()->write_off)
+		return false;
+
+	len = get_le32(view + pos);
+	if (pos + 4 + len > header()->write_off)
+		return false;
+
+	data = view + pos + 4;
+	pos += 4 + len;
+	return true;
+}
+
+void SpillLog::consume(uint64_t n_bytes)
+{
+	if (!is_open())
+		return;
+
+	Header* h = header();
+	h->read_off = std::min(h->read_off + n_bytes, h->write_off);
+
+	// Reclaim everything once all records are acknowledged
+	if (h->read_off == h->write_off) {
+		h->read_off = sizeof(Header);
+		h->write_off = sizeof(Header);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * Append-only queue of records in a memory-mapped file, used to hold
+ * sentences while the receiver is unreachable and across restarts.
+ *
+ * Records are a 4 byte little endian length followed by the payload.
+ * Readers walk records from a cursor and acknowledge them by byte count
+ * once delivered. Acknowledged space is reclaimed when the log runs empty
+ * or when an append needs room. The file has a fixed size, so memory use
+ * does not grow with the backlog.
+ *
+ * Not thread-safe, meant to be owned by the I/O thread.
+ */
+class SpillLog {
+public:
+	SpillLog() = default;
+	~SpillLog();
+
+	SpillLog(SpillLog const&) = delete;
+	SpillLog& operator=(SpillLog const&) = delete;
+
+	/**
+	 * Open or create the log at filepath with room for capacity bytes.
+	 * Existing unacknowledged records are kept.
+	 */
+	bool open(std::wstring const& filepath, uint64_t capacity);
+	void close();
+
+	bool is_open() const { return view != NULL; }
+	bool empty() const;
+
+	/**
+	 * Append a record. Returns false if there is no room left.
+	 */
+	bool push(char const* data, size_t len);
+
+	/**
+	 * Cursor at the oldest unacknowledged record
+	 */
+	uint64_t begin() const;
+
+	/**
+	 * Read the record at pos and advance pos past it.
+	 * Returns false at the end of the log.
+	 */
+	bool read(uint64_t& pos, char const*& data, uint32_t& len) const;
+
+	/**
+	 * Drop the oldest n_bytes worth of records, i.e. the distance a cursor
+	 * from begin() was advanced. Unlike cursors this stays valid across
+	 * push(), which may move records.
+	 */
+	void consume(uint64_t n_bytes);
+
+	/**
+	 * Bytes of unacknowledged records
+	 */
+	uint64_t size() const;
+
+private:
+	struct Header;
+
+	Header* header() const { return (Header*) view; }
+	void compact();
+
+	/**
+	 * Open filepath and map at least capacity bytes of it into view
+	 */
+	bool map(std::wstring const& filepath, uint64_t capacity);
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int fd = -1;
+#endif
+	char* view = NULL;
+	uint64_t capacity = 0;
+};
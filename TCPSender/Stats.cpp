@@ -0,0 +1,77 @@
+#include "Stats.h"
+
+using std::string;
+
+uint64_t Histogram::bucket_high(size_t i)
+{
+	if (i < HIST_SUB)
+		return i;
+
+	unsigned shift = (unsigned) (i / HIST_SUB) - 1;
+	uint64_t low = (uint64_t) (HIST_SUB + i % HIST_SUB) << shift;
+	return low + ((uint64_t) 1 << shift) - 1;
+}
+
+void Histogram::read(HistogramCounts& out) const
+{
+	for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+		uint64_t n = buckets[i].load(std::memory_order_relaxed);
+		out.buckets[i] += n;
+		out.total += n;
+	}
+}
+
+void Histogram::clear()
+{
+	for (std::atomic<uint64_t>& b : buckets)
+		b.store(0, std::memory_order_relaxed);
+}
+
+uint64_t HistogramCounts::percentile(double p) const
+{
+	if (total == 0)
+		return 0;
+
+	// Rank of the value, counted from 1
+	uint64_t rank = (uint64_t) (p * total);
+	if (rank < total)
+		++rank;
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen >= rank)
+			return Histogram::bucket_high(i);
+	}
+	return max();
+}
+
+uint64_t HistogramCounts::max() const
+{
+	for (size_t i = HIST_BUCKETS; i > 0; --i)
+		if (buckets[i - 1] > 0)
+			return Histogram::bucket_high(i - 1);
+	return 0;
+}
+
+void append_metric(string& out, char const* name, string const& labels,
+	uint64_t value)
+{
+	out += name;
+	if (!labels.empty())
+		out += "{" + labels + "}";
+	out += " " + std::to_string(value) + "\n";
+}
+
+void append_histogram(string& out, char const* name, string const& labels,
+	HistogramCounts const& counts)
+{
+	string sep = labels.empty() ? "" : labels + ",";
+	string base = name;
+
+	append_metric(out, (base + "_count").c_str(), labels, counts.total);
+	append_metric(out, name, sep + "quantile=\"0.5\"", counts.percentile(0.5));
+	append_metric(out, name, sep + "quantile=\"0.99\"", counts.percentile(0.99));
+	append_metric(out, name, sep + "quantile=\"0.999\"", counts.percentile(0.999));
+	append_metric(out, (base + "_max").c_str(), labels, counts.max());
+}
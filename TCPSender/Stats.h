@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Values below 2^HIST_SUB_BITS are counted exactly, above that every power
+// of two is split into 2^HIST_SUB_BITS buckets, i.e. about 6% resolution
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1u << HIST_SUB_BITS)
+
+// Larger values are counted in the last bucket
+#define HIST_MAX_BITS 36
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/**
+ * Index of the highest set bit, v must not be 0
+ */
+inline unsigned highest_bit(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	if (_BitScanReverse(&i, (unsigned long) (v >> 32)))
+		return (unsigned) i + 32;
+	_BitScanReverse(&i, (unsigned long) v);
+	return (unsigned) i;
+#else
+	return 63 - (unsigned) __builtin_clzll(v);
+#endif
+}
+
+/**
+ * Counts copied out of a Histogram, see Histogram::read
+ */
+struct HistogramCounts {
+	uint64_t buckets[HIST_BUCKETS] = {};
+	uint64_t total = 0;
+
+	/**
+	 * Upper bound of the bucket holding the value at fraction p of all
+	 * values, 0 if there are none
+	 */
+	uint64_t percentile(double p) const;
+
+	/**
+	 * Upper bound of the highest non-empty bucket
+	 */
+	uint64_t max() const;
+};
+
+/**
+ * Log-linear histogram in the style of HdrHistogram with a fixed range.
+ *
+ * Recording is a single relaxed increment and safe from any number of
+ * threads. Readers get a consistent enough picture for display without
+ * stopping the writers.
+ */
+class Histogram {
+public:
+	static size_t bucket(uint64_t v)
+	{
+		if (v < HIST_SUB)
+			return (size_t) v;
+
+		unsigned bit = highest_bit(v);
+		if (bit >= HIST_MAX_BITS)
+			return HIST_BUCKETS - 1;
+
+		unsigned shift = bit - HIST_SUB_BITS;
+		return (size_t) (shift + 1) * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+	}
+
+	/**
+	 * Largest value counted in bucket i
+	 */
+	static uint64_t bucket_high(size_t i);
+
+	void record(uint64_t v)
+	{
+		buckets[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Add the counts to out, so several histograms can be merged
+	 */
+	void read(HistogramCounts& out) const;
+
+	/**
+	 * Zero all buckets. Values recorded meanwhile may survive.
+	 */
+	void clear();
+
+private:
+	std::atomic<uint64_t> buckets[HIST_BUCKETS] = {};
+};
+
+/**
+ * Counters of one receiver's connection. Written by the I/O thread, read
+ * by anyone.
+ */
+struct LinkStats {
+	std::atomic<uint64_t> connects{0};
+	std::atomic<uint64_t> connect_failures{0};
+	std::atomic<uint64_t> disconnects{0};
+
+	std::atomic<uint64_t> sentences_sent{0};
+	std::atomic<uint64_t> bytes_sent{0};
+
+	// Microseconds from capture until the sentence was written to the socket
+	Histogram send_latency_us;
+
+	static void add(std::atomic<uint64_t>& ctr, uint64_t n = 1)
+	{
+		ctr.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	static uint64_t get(std::atomic<uint64_t> const& ctr)
+	{
+		return ctr.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+ * Append a plain text metric line "name{labels} value"
+ */
+void append_metric(std::string& out, char const* name,
+	std::string const& labels, uint64_t value);
+
+/**
+ * Append count, percentile and max lines of a histogram
+ */
+void append_histogram(std::string& out, char const* name,
+	std::string const& labels, HistogramCounts const& counts);
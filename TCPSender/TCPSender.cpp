@@ -1,13 +1,15 @@
 #include "resource.h"
+#include "Config.h"
 #include "Extension.h"
+#include "Log.h"
+#include "LogRing.h"
+#include "Sender.h"
+#include "SentenceFields.h"
+#include "Utf.h"
 
 #include <atomic>
-#include <codecvt>
-#include <condition_variable>
-#include <deque>
+#include <cwchar>
 #include <filesystem>
-#include <fstream>
-#include <locale>
 #include <mutex>
 #include <string>
 
@@ -19,11 +21,8 @@
 using std::filesystem::path;
 using std::lock_guard;
 using std::mutex;
-using std::unique_lock;
 using std::string;
 using std::wstring;
-using std::wstring_convert;
-using std::codecvt_utf8_utf16;
 
 #ifdef _MSC_VER
 #pragma comment (lib, "Ws2_32.lib")
@@ -31,11 +30,18 @@ using std::codecvt_utf8_utf16;
 #pragma comment (lib, "AdvApi32.lib")
 #endif
 
-#define MSG_Q_CAP 10
 #define CONFIG_APP_NAME L"TCPSend"
 #define CONFIG_ENTRY_REMOTE L"Remote"
 #define CONFIG_ENTRY_CONNECT L"WantConnect"
 #define CONFIG_FILE_NAME L"tcpsender.config"
+#define LOG_RING_CAP 256
+#define LOG_MAX_LINES 200
+#define LOG_FLUSH_INTERVAL_MS 16
+#define LOG_TIMER_ID 1
+#define STATUS_TEXT_LEN 64
+#define STATS_TIMER_ID 2
+#define STATS_REFRESH_MS 500
+#define STATS_TEXT_LEN 256
 
 HMODULE hmod = NULL;
 HWND win_hndl = NULL;
@@ -43,21 +49,24 @@ HWND win_hndl = NULL;
 UINT const WM_USR_LOG = WM_APP + 1;
 UINT const WM_USR_TOGGLE_CONNECT = WM_APP + 2;
 UINT const WM_USR_LOAD_CONFIG = WM_APP + 3;
+UINT const WM_USR_STATUS = WM_APP + 4;
 
-HANDLE comm_thread;
-wstring remote = L"localhost:30501";
+// Lines waiting for the dialog, which flushes them at most once per frame
+LogRing log_ring{LOG_RING_CAP};
+ULONGLONG log_last_flush = 0;
+
+HANDLE io_thread;
 wstring config_file_path;
 
-// Mutex/cv protects following vars
+// Mutex protects following vars
 mutex conn_mut;
-std::condition_variable conn_cv;
-std::atomic<bool> comm_thread_run;
 std::atomic<bool> want_connect;
-std::atomic<bool> config_initialized;
-std::deque<wstring> msg_q;
+Config config;
 
-SOCKET _connect();
-bool _send(SOCKET &, string const &);
+// Everything but the dialog, runs its I/O loop on io_thread
+Sender sender{[] {
+	PostMessage(win_hndl, WM_USR_STATUS, (WPARAM) NULL, (LPARAM) NULL);
+}};
 
 wstring getEditBoxText(HWND win_hndl, int item) {
 	if (win_hndl == NULL)
@@ -88,17 +97,94 @@ wstring getEditBoxText(HWND win_hndl, int item) {
 void log(string const& msg)
 {
 	// Async to allow logging from dialog thread
-	// Freed on message handling
-	char* buf = (char *) GlobalAlloc(GPTR, msg.length() + 1);
-	msg.copy(buf, msg.length());
-	PostMessage(win_hndl, WM_USR_LOG, (WPARAM) NULL, (LPARAM) buf);
+	// Only the first line after a flush posts a message
+	// If the message queue is full or the dialog is gone, let the next line
+	// try again or the log would never refresh
+	if (log_ring.push(msg.data(), msg.length())
+			&& !PostMessage(win_hndl, WM_USR_LOG, (WPARAM) NULL, (LPARAM) NULL))
+		log_ring.wake_failed();
+}
+
+/**
+ * Append pending log lines to the log box and drop the oldest lines over
+ * LOG_MAX_LINES, without reading back the existing text
+ */
+void flush_log(HWND hWnd)
+{
+	string pending;
+	size_t dropped = log_ring.take(pending);
+	log_last_flush = GetTickCount64();
+
+	if (dropped > 0)
+		pending.insert(0, "(" + std::to_string(dropped) + " log lines dropped)\r\n");
+
+	wstring text;
+	append_utf16(text, pending.data(), pending.length());
+
+	HWND edit = GetDlgItem(hWnd, IDC_LOG);
+	int end = GetWindowTextLength(edit);
+	SendMessage(edit, EM_SETSEL, end, end);
+	SendMessage(edit, EM_REPLACESEL, FALSE, (LPARAM) text.c_str());
+
+	// Last line is the empty one after the final line break
+	int lines = (int) SendMessage(edit, EM_GETLINECOUNT, 0, 0);
+	if (lines - 1 > LOG_MAX_LINES) {
+		LRESULT cut = SendMessage(edit, EM_LINEINDEX, lines - 1 - LOG_MAX_LINES, 0);
+		SendMessage(edit, EM_SETSEL, 0, cut);
+		SendMessage(edit, EM_REPLACESEL, FALSE, (LPARAM) L"");
+	}
+
+	SendMessage(edit, EM_LINESCROLL, 0, INT_MAX);
 }
 
 void log(wstring const& msg)
 {
-	string tmp =
-		wstring_convert<codecvt_utf8_utf16<wchar_t>>{}.to_bytes(msg);
-	log(tmp);
+	log(to_utf8(msg));
+}
+
+/**
+ * Show the counters of all receivers, summed up. Called on a timer rather
+ * than per sentence, the text is only replaced if it changed.
+ */
+void refresh_stats(HWND hWnd)
+{
+	static wchar_t shown[STATS_TEXT_LEN];
+
+	unsigned long long queued = 0, sent = 0, dropped = 0;
+	unsigned long long lost = 0, failed = 0;
+	HistogramCounts latency;
+
+	for (unsigned i = 0; i < MAX_REMOTES; ++i) {
+		LinkStats const& st = sender.link_stats(i);
+		queued += sender.queue_depth(i);
+		dropped += sender.queue_dropped(i);
+		sent += LinkStats::get(st.sentences_sent);
+		lost += LinkStats::get(st.disconnects);
+		failed += LinkStats::get(st.connect_failures);
+		st.send_latency_us.read(latency);
+	}
+
+	wchar_t text[STATS_TEXT_LEN];
+	StringCchPrintf(text, STATS_TEXT_LEN,
+		L"Sent %llu, queued %llu, dropped %llu, duplicates %llu\r\n"
+		L"Latency p50 %.1f ms, p99 %.1f ms, %llu disconnects,"
+		L" %llu failed connects",
+		sent, queued, dropped, (unsigned long long) sender.duplicates(),
+		latency.percentile(0.5) / 1000.0, latency.percentile(0.99) / 1000.0,
+		lost, failed);
+
+	if (wcscmp(text, shown) == 0)
+		return;
+	StringCchCopy(shown, STATS_TEXT_LEN, text);
+	SetDlgItemText(hWnd, IDC_STATS, text);
+}
+
+/**
+ * Hand config to the sender. Call with conn_mut held.
+ */
+void apply_config()
+{
+	sender.configure(config, path{config_file_path}.parent_path());
 }
 
 void toggle_want_connect()
@@ -106,104 +192,28 @@ void toggle_want_connect()
 	PostMessage(win_hndl, WM_USR_TOGGLE_CONNECT, (WPARAM) NULL, (LPARAM) NULL);
 }
 
-void save_config(path const& filepath, wstring const& remote, bool connect)
+void store_config()
 {
-	std::wofstream f{filepath, std::ios_base::trunc};
-	if (f.good()) {
-		f << remote.c_str() << "\n";
-		f << connect;
-	}
-	else {
+	if (!save_config(config_file_path, config))
 		MessageBox(NULL, L"Could not open config file for writing", L"Error", 0);
-	}
 }
 
 /**
- * Connect to remote and wait for messages in queue to send until comm_thread_run is false
+ * Run the sender's I/O loop with Winsock initialized
  */
-DWORD WINAPI comm_loop(LPVOID lpParam)
+DWORD WINAPI io_loop(LPVOID)
 {
-	(void)lpParam;
-
-	using namespace std::chrono_literals;
 	WSADATA wsaData;
 
-	log("Starting comm loop");
-
 	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-		log("Could not initialize WSA. Exit");
+		LOG_ERROR("Could not initialize WSA. Exit");
 		return 1;
 	}
 
-	SOCKET sock = INVALID_SOCKET;
-
-	// Note: The communication thread is one big if/elseif/else. We keep the
-	// mutex locked except when waiting for an event after which we will loop
-	// again to see what happened and on long operations like connection
-	// attempts or sending data.
-	// This allows protecting muliple variables without performance problems.
-	unique_lock<mutex> lk{conn_mut};
-
-	while (!config_initialized) {
-		conn_cv.wait(lk);
-	}
-
-	while (comm_thread_run) {
-		// If we are not connected, try to connect if wanted, wait if we don't
-		if (sock == INVALID_SOCKET) {
-			if (want_connect) {
-				lk.unlock(); // Don't lock for connect
-				sock = _connect();
-				lk.lock();
-				if (sock == INVALID_SOCKET) {
-					log("Connection failed. Retrying soon.");
-					conn_cv.wait_for(lk, 1000ms);
-				} else {
-					log("Successfully connected");
-				}
-			} else {
-				conn_cv.wait(lk);
-			}
-		// If we are connected, but shouldn't be, disconnect
-		} else if (!want_connect) {
-			log("Disconnecting");
-			closesocket(sock);
-			sock = INVALID_SOCKET;
-		// If we are connected but there's no data available, wait
-		} else if (msg_q.empty()) {
-			conn_cv.wait(lk);
-		// We are connected and there is data available
-		} else {
-			// Remove first element, unlock, push back on error
-			wstring msg = msg_q.front();
-			msg_q.pop_front();
-
-			lk.unlock();
-
-			string msg_utf8 =
-				wstring_convert<codecvt_utf8_utf16<wchar_t>>{}.to_bytes(msg);
-			log("Sending '" + msg_utf8 + "'");
-
-			if (!_send(sock, msg_utf8)) {
-				log("Error sending");
-				closesocket(sock);
-				sock = INVALID_SOCKET;
-				lk.lock();
-				if (msg_q.size() < MSG_Q_CAP)
-					msg_q.push_front(msg);
-				lk.unlock();
-			}
-
-			lk.lock();
-		}
-	}
-
-	log("Comm cleanup and exit");
-
-	closesocket(sock);
+	bool ok = sender.run();
 	WSACleanup();
 
-	return 0;
+	return ok ? 0 : 1;
 }
 
 INT_PTR CALLBACK DialogProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
@@ -212,7 +222,11 @@ INT_PTR CALLBACK DialogProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 	{
 	case WM_INITDIALOG:
 	{
-		SetDlgItemText(hWnd, IDC_REMOTE, remote.c_str());
+		SetDlgItemText(hWnd, IDC_REMOTE, config.remote.c_str());
+		// Lift the default 32k limit, flush_log bounds the size instead
+		SendDlgItemMessage(hWnd, IDC_LOG, EM_SETLIMITTEXT, 0, 0);
+		SetTimer(hWnd, STATS_TIMER_ID, STATS_REFRESH_MS, NULL);
+		refresh_stats(hWnd);
 		return true;
 	}
 	case WM_COMMAND:
@@ -221,11 +235,16 @@ INT_PTR CALLBACK DialogProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 		{
 		case IDC_BTN_SUBMIT:
 		{
-			remote = getEditBoxText(hWnd, IDC_REMOTE);
+			config.remote = getEditBoxText(hWnd, IDC_REMOTE);
 			toggle_want_connect();
 
 			break;
 		}
+		case IDC_BTN_TRACE:
+		{
+			sender.log_trace();
+			break;
+		}
 		default:
 			return false;
 		}
@@ -233,21 +252,62 @@ INT_PTR CALLBACK DialogProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 	}
 	case WM_USR_LOG:
 	{
-		wstring tmp = getEditBoxText(hWnd, IDC_LOG);
-		if (tmp.length() > 0)
-			tmp.append(L"\r\n");
+		// Coalesce bursts: delay the flush if the last one was this frame
+		ULONGLONG since = GetTickCount64() - log_last_flush;
+		if (since < LOG_FLUSH_INTERVAL_MS)
+			SetTimer(hWnd, LOG_TIMER_ID, (UINT) (LOG_FLUSH_INTERVAL_MS - since), NULL);
+		else
+			flush_log(hWnd);
+		return true;
+	}
+	case WM_TIMER:
+	{
+		if (wParam == STATS_TIMER_ID) {
+			refresh_stats(hWnd);
+			return true;
+		}
+		if (wParam != LOG_TIMER_ID)
+			return false;
 
-		// Remove older text to not slow down
-		if (tmp.length() > 4000) {
-			tmp.erase(0, 2000);
+		KillTimer(hWnd, LOG_TIMER_ID);
+		flush_log(hWnd);
+		return true;
+	}
+	case WM_USR_STATUS:
+	{
+		wchar_t text[STATUS_TEXT_LEN];
+		ReceiverStatus status = sender.status(0);
+		unsigned n = sender.receiver_count();
+
+		if (n > 1) {
+			unsigned connected = 0;
+			for (unsigned i = 0; i < n; ++i)
+				connected += sender.status(i).state == ConnState::CONNECTED;
+
+			StringCchPrintf(text, STATUS_TEXT_LEN,
+				L"Connected to %u of %u receivers", connected, n);
+			SetDlgItemText(hWnd, IDC_STATUS, text);
+			return true;
 		}
 
-		char* buf = (char *) lParam;
-		tmp.append(wstring_convert<codecvt_utf8_utf16<wchar_t>>().from_bytes(buf));
-		GlobalFree(buf);
+		switch (status.state) {
+		case ConnState::DISCONNECTED:
+			StringCchCopy(text, STATUS_TEXT_LEN, L"Disconnected");
+			break;
+		case ConnState::CONNECTING:
+			StringCchCopy(text, STATUS_TEXT_LEN, L"Connecting...");
+			break;
+		case ConnState::CONNECTED:
+			StringCchCopy(text, STATUS_TEXT_LEN, L"Connected");
+			break;
+		case ConnState::WAITING:
+			StringCchPrintf(text, STATUS_TEXT_LEN,
+				L"Retrying in %.1fs (attempt %u)",
+				status.retry_delay_ms / 1000.0, status.retry_attempt);
+			break;
+		}
 
-		SetDlgItemText(hWnd, IDC_LOG, tmp.c_str());
-		SendMessage(GetDlgItem(hWnd, IDC_LOG), EM_LINESCROLL, 0, INT_MAX);
+		SetDlgItemText(hWnd, IDC_STATUS, text);
 		return true;
 	}
 	case WM_USR_TOGGLE_CONNECT:
@@ -267,34 +327,29 @@ INT_PTR CALLBACK DialogProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 			SendMessage(edit, EM_SETREADONLY, FALSE, (LPARAM) NULL);
 		}
 
-		save_config(config_file_path, remote, want_connect);
+		config.connect = want_connect;
+		store_config();
 
-		conn_cv.notify_one();
+		apply_config();
 		return true;
 	}
 	case WM_USR_LOAD_CONFIG:
 	{
 		lock_guard<mutex> conn_lk{ conn_mut };
 
-		log(L"Loading config: " + wstring{(wchar_t*) lParam});
-		std::wifstream f{(wchar_t *) lParam};
-		if (f.fail()) {
-			log("Config file does not exist.");
+		LOG_INFO(L"Loading config: " + wstring{(wchar_t*) lParam});
+		if (!load_config((wchar_t *) lParam, config)) {
+			LOG_INFO("Config file does not exist.");
 			goto config_done;
 		}
 
-		std::getline(f, remote);
-		SetDlgItemText(win_hndl, IDC_REMOTE, remote.c_str());
+		SetDlgItemText(win_hndl, IDC_REMOTE, config.remote.c_str());
 
-		bool connect;
-		f >> connect;
-		if (connect)
+		if (config.connect)
 			toggle_want_connect();
 
 config_done:
-		comm_thread_run = true;
-		config_initialized = true;
-		conn_cv.notify_one();
+		apply_config();
 
 		return true;
 	}
@@ -340,22 +395,16 @@ BOOL WINAPI DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved
 		PostMessage(win_hndl, WM_USR_LOAD_CONFIG,
 			(WPARAM) NULL, (LPARAM) config_file_path.c_str());
 
-		// Start communication thread
-		comm_thread = CreateThread(NULL, 0, comm_loop, NULL, 0, NULL);
+		io_thread = CreateThread(NULL, 0, io_loop, NULL, 0, NULL);
 	}
 	break;
 	case DLL_PROCESS_DETACH:
 	{
-		// Signal and wait for cleanup of comm thread would be good but
+		// Signal and wait for cleanup of I/O thread would be good but
 		// join/WaitForSingleObject does not work in DLL_PROCESS_DETACH
 
-		// unique_lock<mutex> lk{ conn_mut };
-		// comm_thread_run = false;
-		// conn_cv.notify_one();
-		// lk.unlock();
-
-		// if (comm_thread.joinable())
-		//	comm_thread.join();
+		// sender.stop();
+		// WaitForSingleObject(io_thread, INFINITE);
 
 		DestroyWindow(win_hndl);
 	}
@@ -364,89 +413,19 @@ BOOL WINAPI DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved
 	return true;
 }
 
-SOCKET _connect() {
-	SOCKET sock;
-	struct addrinfo* result = NULL,
-		* ptr = NULL,
-		hints;
-	ZeroMemory(&hints, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
-
-	string remote_ch =
-		wstring_convert<codecvt_utf8_utf16<wchar_t>>{}.to_bytes(remote);
-
-	log("Connecting to " + remote_ch);
-
-	string::size_type pos = remote_ch.rfind(":");
-	string port = pos == string::npos ? "30501" : remote_ch.substr(pos + 1);
-	int res = getaddrinfo(remote_ch.substr(0, pos).c_str(), port.c_str(), &hints, &result);
-	if (res != 0) {
-		return INVALID_SOCKET;
-	}
-
-	for (ptr = result; ptr != NULL; ptr = ptr->ai_next) {
-		sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-		if (sock == INVALID_SOCKET) {
-			return sock;
-		}
-
-		res = connect(sock, ptr->ai_addr, (int)ptr->ai_addrlen);
-		if (res == SOCKET_ERROR) {
-			closesocket(sock);
-			sock = INVALID_SOCKET;
-			continue;
-		}
-		break;
-	}
-
-	freeaddrinfo(result);
-
-	return sock;
-}
-
-bool _send(SOCKET &sock, string const &msg) {
-	int len = (int) msg.length();
-	int buf_len = len + 4;
-	char* buf = new char[buf_len + 1];
-
-	strcpy_s(buf + 4, buf_len - 4 + 1, msg.c_str());
-	*((uint32_t*)buf) = len;
-
-	for (int sent = 0, ret = 0; sent < buf_len; sent += ret) {
-		ret = send(sock, buf + sent, buf_len - sent, 0);
-		if (ret == SOCKET_ERROR) {
-			delete[] buf;
-			return false;
-		}
-	}
-	delete[] buf;
-	return true;
-}
-
 /*
-   Param sentence: sentence received by Textractor (UTF-16). Can be modified, Textractor will receive this modification only if true is returned.
+   Read-only counterpart of ProcessSentence, the sentence is never modified.
+   Param sentence: null terminated sentence received by Textractor (UTF-16). Owned by Textractor and only valid during the call.
    Param sentenceInfo: contains miscellaneous info about the sentence (see README).
-   Return value: whether the sentence was modified.
-   Textractor will display the sentence after all extensions have had a chance to process and/or modify it.
-   The sentence will be destroyed if it is empty or if you call Skip().
    This function may be run concurrently with itself: please make sure it's thread safe.
    It will not be run concurrently with DllMain.
    */
-bool ProcessSentence(wstring & sentence, SentenceInfo sentenceInfo)
+void ObserveSentence(wchar_t const* sentence, SentenceInfo sentenceInfo)
 {
-	if (sentenceInfo["current select"]) {
-		log("Received sentence");
-
-		lock_guard<mutex> lock{conn_mut};
-
-		if (msg_q.size() >= MSG_Q_CAP)
-			msg_q.pop_front();
-
-		msg_q.push_back(wstring{ sentence });
-		conn_cv.notify_one();
-	}
+	SentenceFields info{sentenceInfo};
 
-	return false;
+	sender.submit(sentence, info.get_or(InfoKey::CURRENT_SELECT, 0) != 0,
+		(wchar_t const*) (intptr_t) info.get_or(InfoKey::TEXT_NAME, 0),
+		(uint32_t) info.get_or(InfoKey::TEXT_NUMBER, 0),
+		(uint32_t) info.get_or(InfoKey::PROCESS_ID, 0));
 }
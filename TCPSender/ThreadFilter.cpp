@@ -0,0 +1,34 @@
+#include "ThreadFilter.h"
+#include "Config.h"
+
+#include <cwchar>
+
+using std::vector;
+using std::wstring;
+
+static bool contains(vector<wstring> const& names, wchar_t const* name)
+{
+	for (auto const& n : names)
+		if (wcscmp(n.c_str(), name) == 0)
+			return true;
+	return false;
+}
+
+ThreadFilter::ThreadFilter(bool forward_all, wstring const& allow,
+		wstring const& deny)
+	: forward_all{forward_all}, allow{split_list(allow)},
+	  deny{split_list(deny)}
+{
+}
+
+bool ThreadFilter::accept(bool selected, wchar_t const* name) const
+{
+	if (selected)
+		return true;
+	if (!forward_all)
+		return false;
+	if (name == nullptr)
+		name = L"";
+
+	return (allow.empty() || contains(allow, name)) && !contains(deny, name);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Decides on the hook thread which Textractor text threads are forwarded.
+ *
+ * The thread selected in Textractor is always forwarded. Other threads
+ * only with forward_all, and then only if their name is in the allow list
+ * (or the allow list is empty) and not in the deny list. Lists hold text
+ * thread names separated by commas.
+ *
+ * Immutable once built, a config change replaces the whole filter.
+ */
+class ThreadFilter {
+public:
+	ThreadFilter() = default;
+	ThreadFilter(bool forward_all, std::wstring const& allow,
+		std::wstring const& deny);
+
+	/**
+	 * Cheap check done before the name is looked up
+	 */
+	bool forwards_unselected() const { return forward_all; }
+
+	bool accept(bool selected, wchar_t const* name) const;
+
+private:
+	bool forward_all = false;
+	std::vector<std::wstring> allow;
+	std::vector<std::wstring> deny;
+};
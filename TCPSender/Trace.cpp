@@ -0,0 +1,46 @@
+#include "Trace.h"
+
+#include <cstdio>
+
+using std::string;
+
+static char const* const stage_names[] = {
+	"convert",
+	"enqueue",
+	"queued",
+	"send",
+	"total"
+};
+
+void StageTrace::enable(bool enable)
+{
+	if (enable && !on.load(std::memory_order_relaxed)) {
+		for (Histogram& h : stages)
+			h.clear();
+	}
+	on.store(enable, std::memory_order_relaxed);
+}
+
+void StageTrace::append_metrics(string& out) const
+{
+	for (size_t i = 0; i < (size_t) Stage::COUNT; ++i) {
+		HistogramCounts counts;
+		stages[i].read(counts);
+		append_histogram(out, "tcpsender_stage_latency_ns",
+			"stage=\"" + string{stage_names[i]} + "\"", counts);
+	}
+}
+
+string StageTrace::summary(Stage stage) const
+{
+	HistogramCounts counts;
+	stages[(size_t) stage].read(counts);
+
+	char line[160];
+	snprintf(line, sizeof(line), "%-7s %llu sentences, p50 %.1f us,"
+		" p99 %.1f us, p999 %.1f us, max %.1f us",
+		stage_names[(size_t) stage], (unsigned long long) counts.total,
+		counts.percentile(0.5) / 1000.0, counts.percentile(0.99) / 1000.0,
+		counts.percentile(0.999) / 1000.0, counts.max() / 1000.0);
+	return line;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Pipeline stages of a sentence, each measured from the end of the one
+ * before it
+ */
+enum class Stage {
+	CONVERT,  // Entering submit until encoded to UTF-8
+	ENQUEUE,  // Until pushed to a receiver's queue
+	QUEUED,   // Until taken from the queue by the I/O loop
+	SEND,     // Until the batch holding it was written to the socket
+	TOTAL,    // Entering submit until written
+	COUNT
+};
+
+/**
+ * Stage times of a frame in a batch, see StageTrace
+ */
+struct FrameTrace {
+	uint64_t entry_ns;
+	uint64_t dequeued_ns;
+};
+
+/**
+ * Optional per-stage latency histograms of sentences.
+ *
+ * Disabled, every stage costs a relaxed load. Enabled, a clock read and a
+ * relaxed increment. Durations are recorded in nanoseconds, so the
+ * histograms cover up to about a minute.
+ *
+ * Sentences carry their timestamps through the queue. A timestamp of 0
+ * means the sentence is not traced, e.g. because it was queued before
+ * tracing was enabled or replayed from the spill log.
+ */
+class StageTrace {
+public:
+	/**
+	 * Histograms start over whenever tracing is turned on
+	 */
+	void enable(bool on);
+	bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+	/**
+	 * Monotonic timestamp, never 0
+	 */
+	static uint64_t now_ns()
+	{
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count() | 1;
+	}
+
+	void record(Stage stage, uint64_t from_ns, uint64_t to_ns)
+	{
+		if (from_ns == 0)
+			return;
+		stages[(size_t) stage].record(to_ns > from_ns ? to_ns - from_ns : 0);
+	}
+
+	/**
+	 * Count and percentiles of all stages in nanoseconds, see
+	 * append_histogram
+	 */
+	void append_metrics(std::string& out) const;
+
+	/**
+	 * Count and percentiles of one stage as a line for the log
+	 */
+	std::string summary(Stage stage) const;
+
+private:
+	Histogram stages[(size_t) Stage::COUNT];
+	std::atomic<bool> on{false};
+};
@@ -0,0 +1,267 @@
+#include "Utf.h"
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#define UTF_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) \
+	|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTF_SSE2
+#include <emmintrin.h>
+#endif
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+// Vector loops only apply to 16 bit code units and only handle runs of ASCII,
+// which covers the markup, names and romaji mixed into most game text.
+// Everything else falls through to the scalar loops below.
+
+/**
+ * Copy the leading ASCII run of src to dst in blocks.
+ * Returns the number of code units consumed (and bytes written).
+ */
+static size_t ascii_run_16_to_8(uint16_t const* src, size_t n, char* dst)
+{
+	size_t i = 0;
+#if defined(UTF_AVX2)
+	__m256i const mask = _mm256_set1_epi16((short) 0xFF80);
+	for (; i + 16 <= n; i += 16) {
+		__m256i v = _mm256_loadu_si256((__m256i const*) (src + i));
+		if (!_mm256_testz_si256(v, mask))
+			break;
+		// packus works per 128 bit lane, so pack the two halves by hand
+		__m128i lo = _mm256_castsi256_si128(v);
+		__m128i hi = _mm256_extracti128_si256(v, 1);
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+#if defined(UTF_AVX2) || defined(UTF_SSE2)
+	__m128i const mask128 = _mm_set1_epi16((short) 0xFF80);
+	__m128i const zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((__m128i const*) (src + i));
+		__m128i high = _mm_and_si128(v, mask128);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+			break;
+		_mm_storel_epi64((__m128i*) (dst + i), _mm_packus_epi16(v, v));
+	}
+#else
+	(void) src;
+	(void) n;
+	(void) dst;
+#endif
+	return i;
+}
+
+/**
+ * Widen the leading ASCII run of src to dst in blocks.
+ * Returns the number of bytes consumed (and code units written).
+ */
+static size_t ascii_run_8_to_16(char const* src, size_t n, uint16_t* dst)
+{
+	size_t i = 0;
+#if defined(UTF_AVX2) || defined(UTF_SSE2)
+	__m128i const zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i const*) (src + i));
+		if (_mm_movemask_epi8(v) != 0)
+			break;
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i*) (dst + i + 8), _mm_unpackhi_epi8(v, zero));
+	}
+#else
+	(void) src;
+	(void) n;
+	(void) dst;
+#endif
+	return i;
+}
+
+static char* put_utf8(char* d, uint32_t c)
+{
+	if (c < 0x80) {
+		*d++ = (char) c;
+	} else if (c < 0x800) {
+		*d++ = (char) (0xC0 | (c >> 6));
+		*d++ = (char) (0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		*d++ = (char) (0xE0 | (c >> 12));
+		*d++ = (char) (0x80 | ((c >> 6) & 0x3F));
+		*d++ = (char) (0x80 | (c & 0x3F));
+	} else {
+		*d++ = (char) (0xF0 | (c >> 18));
+		*d++ = (char) (0x80 | ((c >> 12) & 0x3F));
+		*d++ = (char) (0x80 | ((c >> 6) & 0x3F));
+		*d++ = (char) (0x80 | (c & 0x3F));
+	}
+	return d;
+}
+
+/**
+ * utf16_to_utf8 for 16 bit (UTF-16) or 32 bit (UTF-32) code units
+ */
+template <typename Unit>
+static size_t encode(Unit const* src, size_t n, char* dst)
+{
+	char* d = dst;
+	size_t i = 0;
+
+	while (i < n) {
+		if constexpr (sizeof(Unit) == 2) {
+			size_t run = ascii_run_16_to_8((uint16_t const*) src + i,
+				n - i, d);
+			i += run;
+			d += run;
+		}
+
+		// Scalar until the next ASCII character after a non-ASCII one, so
+		// the vector loop gets another chance on mixed text
+		for (bool seen_wide = false; i < n; ++i) {
+			uint32_t c = (uint32_t) src[i];
+
+			if (c < 0x80) {
+				if (seen_wide)
+					break;
+				*d++ = (char) c;
+				continue;
+			}
+			seen_wide = true;
+
+			if (c >= 0xD800 && c <= 0xDFFF) {
+				uint32_t c2 = i + 1 < n ? (uint32_t) src[i + 1] : 0;
+				if (sizeof(Unit) == 2 && c <= 0xDBFF
+						&& c2 >= 0xDC00 && c2 <= 0xDFFF) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+					++i;
+				} else {
+					c = REPLACEMENT_CHAR;
+				}
+			} else if (c > 0x10FFFF) {
+				c = REPLACEMENT_CHAR;
+			}
+			d = put_utf8(d, c);
+		}
+	}
+
+	return d - dst;
+}
+
+/**
+ * Decode one multi byte sequence starting at src[i], lead byte b0.
+ * Returns the code point or REPLACEMENT_CHAR and advances i past the
+ * consumed bytes (only the lead byte if the sequence is invalid).
+ */
+static uint32_t decode_seq(unsigned char const* src, size_t n, size_t& i)
+{
+	unsigned char b0 = src[i];
+	size_t len;
+	uint32_t c, min;
+
+	if (b0 >= 0xC2 && b0 <= 0xDF) {
+		len = 2; c = b0 & 0x1F; min = 0x80;
+	} else if (b0 >= 0xE0 && b0 <= 0xEF) {
+		len = 3; c = b0 & 0x0F; min = 0x800;
+	} else if (b0 >= 0xF0 && b0 <= 0xF4) {
+		len = 4; c = b0 & 0x07; min = 0x10000;
+	} else {
+		++i;
+		return REPLACEMENT_CHAR;
+	}
+
+	if (i + len > n) {
+		++i;
+		return REPLACEMENT_CHAR;
+	}
+
+	for (size_t k = 1; k < len; ++k) {
+		unsigned char b = src[i + k];
+		if ((b & 0xC0) != 0x80) {
+			++i;
+			return REPLACEMENT_CHAR;
+		}
+		c = (c << 6) | (b & 0x3F);
+	}
+
+	if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+		++i;
+		return REPLACEMENT_CHAR;
+	}
+
+	i += len;
+	return c;
+}
+
+/**
+ * utf8_to_utf16 for 16 bit (UTF-16) or 32 bit (UTF-32) code units
+ */
+template <typename Unit>
+static size_t decode(char const* src, size_t n, Unit* dst)
+{
+	unsigned char const* s = (unsigned char const*) src;
+	Unit* d = dst;
+	size_t i = 0;
+
+	while (i < n) {
+		if constexpr (sizeof(Unit) == 2) {
+			size_t run = ascii_run_8_to_16(src + i, n - i, (uint16_t*) d);
+			i += run;
+			d += run;
+		}
+
+		for (bool seen_wide = false; i < n; ) {
+			if (s[i] < 0x80) {
+				if (seen_wide)
+					break;
+				*d++ = (Unit) s[i++];
+				continue;
+			}
+			seen_wide = true;
+
+			uint32_t c = decode_seq(s, n, i);
+			if (sizeof(Unit) == 2 && c >= 0x10000) {
+				c -= 0x10000;
+				*d++ = (Unit) (0xD800 + (c >> 10));
+				*d++ = (Unit) (0xDC00 + (c & 0x3FF));
+			} else {
+				*d++ = (Unit) c;
+			}
+		}
+	}
+
+	return d - dst;
+}
+
+size_t utf16_to_utf8(wchar_t const* src, size_t n, char* dst)
+{
+	return encode(src, n, dst);
+}
+
+size_t utf16_to_utf8(char16_t const* src, size_t n, char* dst)
+{
+	return encode(src, n, dst);
+}
+
+size_t utf8_to_utf16(char const* src, size_t n, wchar_t* dst)
+{
+	return decode(src, n, dst);
+}
+
+size_t utf8_to_utf16(char const* src, size_t n, char16_t* dst)
+{
+	return decode(src, n, dst);
+}
+
+void append_utf8(std::string& out, wchar_t const* src, size_t n)
+{
+	size_t off = out.size();
+	out.resize(off + utf8_max_len(n));
+	out.resize(off + utf16_to_utf8(src, n, &out[off]));
+}
+
+void append_utf16(std::wstring& out, char const* src, size_t n)
+{
+	size_t off = out.size();
+	out.resize(off + n);
+	out.resize(off + utf8_to_utf16(src, n, &out[off]));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Upper bound of UTF-8 bytes needed for n wchar_t code units
+ */
+constexpr size_t utf8_max_len(size_t n)
+{
+	return n * (sizeof(wchar_t) == 2 ? 3 : 4);
+}
+
+/**
+ * Encode n code units of UTF-16 (UTF-32 where wchar_t is 32 bit) into dst,
+ * which must hold utf8_max_len(n) bytes. Unpaired surrogates and invalid
+ * code points become U+FFFD.
+ * Returns the number of bytes written.
+ */
+size_t utf16_to_utf8(wchar_t const* src, size_t n, char* dst);
+
+/**
+ * Decode n bytes of UTF-8 into dst, which must hold n code units. Invalid
+ * sequences become U+FFFD.
+ * Returns the number of code units written.
+ */
+size_t utf8_to_utf16(char const* src, size_t n, wchar_t* dst);
+
+/**
+ * As above for UTF-16 in char16_t whatever the size of wchar_t, e.g. to
+ * run the 16 bit code paths on Linux. Needs 3 bytes per code unit.
+ */
+size_t utf16_to_utf8(char16_t const* src, size_t n, char* dst);
+size_t utf8_to_utf16(char const* src, size_t n, char16_t* dst);
+
+/**
+ * Append encoded src to out, e.g. straight behind a frame header
+ */
+void append_utf8(std::string& out, wchar_t const* src, size_t n);
+
+void append_utf16(std::wstring& out, char const* src, size_t n);
+
+inline std::string to_utf8(std::wstring const& s)
+{
+	std::string out;
+	append_utf8(out, s.data(), s.length());
+	return out;
+}
+
+inline std::wstring to_utf16(std::string const& s)
+{
+	std::wstring out;
+	append_utf16(out, s.data(), s.length());
+	return out;
+}
@@ -1257,6 +1257,9 @@
 #define IDC_BTN_SUBMIT2                 1002
 #define IDC_EDIT2                       1003
 #define IDC_LOG                         1003
+#define IDC_STATUS                      1004
+#define IDC_STATS                       1005
+#define IDC_BTN_TRACE                   1006
 #define CF_GDIOBJLAST                   0x03FF
 #define _WIN32_WINNT_NT4                0x0400
 #define _WIN32_IE_IE40                  0x0400
@@ -1618,7 +1621,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        105
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1004
+#define _APS_NEXT_CONTROL_VALUE         1007
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,158 @@
+/*
+ * Micro-benchmark of the zstd stream compression offered with
+ * Compression=1.
+ *
+ * Frames a trace of sentences as version 2 frames and compresses them the
+ * way a connection does, reporting bytes before and after and CPU time
+ * per sentence:
+ *   frame      one stream, flushed after every frame as when sentences
+ *              trickle in one by one
+ *   batch      one stream, flushed after every --batch frames as when the
+ *              I/O thread coalesces a burst into one write
+ *   restart    a new stream for every frame, i.e. without the history of
+ *              earlier sentences, to show what the long-lived context buys
+ *
+ * Usage: compress_bench [--trace FILE] [--count N] [--batch N] [--level N]
+ *   --trace  UTF-8 text file, one sentence per line. Default: generated
+ *   --count  Sentences per variant, default 100000
+ *   --batch  Frames per flush of the batch variant, default 16
+ *   --level  zstd compression level, default 3
+ */
+
+#include "Compress.h"
+#include "Frame.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+#define DEFAULT_COUNT 100000
+#define DEFAULT_BATCH 16
+#define DEFAULT_LEVEL 3
+
+static std::vector<string> load_trace(char const* filepath)
+{
+	std::vector<string> trace;
+
+	if (filepath == NULL) {
+		// Mixed Japanese and ASCII lines of typical length, in UTF-8
+		string const parts[] = {
+			u8"「それじゃあ、また明日」",
+			"Chapter 3: The Lighthouse",
+			u8"彼女は何も言わずに窓の外を見つめていた。",
+			u8"【アリス】",
+		};
+		for (int i = 0; i < 64; ++i) {
+			string s;
+			for (int j = 0; j <= i % 5; ++j)
+				s += parts[(i + j) % 4];
+			trace.push_back(s + std::to_string(i));
+		}
+		return trace;
+	}
+
+	std::ifstream f{filepath, std::ios_base::binary};
+	string line;
+	while (std::getline(f, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			trace.push_back(line);
+	}
+	return trace;
+}
+
+/**
+ * Compress count frames of the trace, flushing every batch frames and
+ * starting a new stream before each flush if restart is set
+ */
+static bool run(char const* name, std::vector<string> const& trace,
+	size_t count, size_t batch, int level, bool restart)
+{
+	StreamCompressor compressor;
+	if (!compressor.start(level)) {
+		fprintf(stderr, "%s: could not start a zstd stream\n", name);
+		return false;
+	}
+
+	string buf, out;
+	SentenceMeta meta;
+	meta.text_number = 1;
+	meta.process_id = 4242;
+	uint64_t n_in = 0, n_out = 0;
+	std::clock_t start = std::clock();
+
+	for (size_t i = 0; i < count; ) {
+		buf.clear();
+		for (size_t j = 0; j < batch && i < count; ++j, ++i) {
+			meta.timestamp_us += 16667;
+			size_t off = begin_frame(buf, FRAME_VERSION_2);
+			buf += trace[i % trace.size()];
+			end_frame(buf, off, FRAME_VERSION_2, i + 1, meta);
+		}
+
+		if (restart && !compressor.start(level))
+			return false;
+		if (!compressor.compress(buf.data(), buf.size(), out)) {
+			fprintf(stderr, "%s: compression failed\n", name);
+			return false;
+		}
+		n_in += buf.size();
+		n_out += out.size();
+	}
+
+	double cpu_ms = (std::clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+	printf("%-8s %10llu -> %10llu bytes  %5.1f%%  %.2f us per sentence\n",
+		name, (unsigned long long) n_in, (unsigned long long) n_out,
+		n_in > 0 ? 100.0 * n_out / n_in : 0.0,
+		count > 0 ? cpu_ms * 1000 / count : 0.0);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	char const* trace_path = NULL;
+	size_t count = DEFAULT_COUNT;
+	size_t batch = DEFAULT_BATCH;
+	int level = DEFAULT_LEVEL;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+
+		if (arg == "--trace" && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = (size_t) strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--batch" && i + 1 < argc) {
+			batch = (size_t) strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--level" && i + 1 < argc) {
+			level = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--trace FILE] [--count N] [--batch N]"
+				" [--level N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (!StreamCompressor::available()) {
+		fprintf(stderr, "Built without zstd\n");
+		return 1;
+	}
+
+	std::vector<string> trace = load_trace(trace_path);
+	if (trace.empty() || batch == 0) {
+		fprintf(stderr, "Nothing to compress\n");
+		return 1;
+	}
+
+	bool ok = run("frame", trace, count, 1, level, false)
+		&& run("batch", trace, count, batch, level, false)
+		&& run("restart", trace, count, 1, level, true);
+	return ok ? 0 : 1;
+}
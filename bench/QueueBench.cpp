@@ -0,0 +1,156 @@
+/*
+ * Contention benchmark of the sentence queue.
+ *
+ * Producer threads push as fast as they can while one consumer pops, as
+ * hook threads and the I/O thread do. Reports pushes per second and drops
+ * of MsgQueue next to the mutex guarded deque it replaced, for each number
+ * of producers up to the given maximum.
+ *
+ * Usage: queue_bench [--producers N] [--count N] [--capacity N]
+ *   --producers  Highest number of producer threads, default 8
+ *   --count      Pushes per producer, default 1000000
+ *   --capacity   Queue capacity, default 16
+ */
+
+#include "MsgQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using clock_type = std::chrono::steady_clock;
+
+#define DEFAULT_PRODUCERS 8
+#define DEFAULT_COUNT 1000000
+#define DEFAULT_CAPACITY 16
+
+/**
+ * The queue before MsgQueue: a deque under a mutex, dropping the oldest
+ * element when full
+ */
+class LockedQueue {
+public:
+	explicit LockedQueue(size_t capacity) : capacity(capacity) {}
+
+	void push(uint64_t v)
+	{
+		std::lock_guard<std::mutex> lk{mut};
+		if (q.size() >= capacity) {
+			q.pop_front();
+			++n_dropped;
+		}
+		q.push_back(v);
+	}
+
+	bool pop(uint64_t& out)
+	{
+		std::lock_guard<std::mutex> lk{mut};
+		if (q.empty())
+			return false;
+		out = q.front();
+		q.pop_front();
+		return true;
+	}
+
+	uint64_t dropped() const { return n_dropped; }
+
+private:
+	std::mutex mut;
+	std::deque<uint64_t> q;
+	size_t capacity;
+	uint64_t n_dropped = 0;
+};
+
+struct Result {
+	double pushes_per_s;
+	uint64_t popped;
+	uint64_t dropped;
+};
+
+template <typename Q, typename Push>
+static Result run(Q& q, Push push, unsigned producers, size_t count)
+{
+	std::atomic<unsigned> running{producers};
+	std::atomic<bool> go{false};
+	std::vector<std::thread> threads;
+
+	for (unsigned p = 0; p < producers; ++p) {
+		threads.emplace_back([&] {
+			while (!go.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			for (size_t i = 0; i < count; ++i)
+				push(q, (uint64_t) i);
+			running.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	uint64_t popped = 0;
+	uint64_t v = 0;
+	auto start = clock_type::now();
+	go.store(true, std::memory_order_release);
+
+	while (running.load(std::memory_order_acquire) > 0)
+		popped += q.pop(v);
+	auto done = clock_type::now();
+	while (q.pop(v))
+		++popped;
+
+	for (std::thread& t : threads)
+		t.join();
+
+	double s = std::chrono::duration<double>(done - start).count();
+	return Result{producers * count / s, popped, q.dropped()};
+}
+
+static void print(char const* name, unsigned producers, Result const& r)
+{
+	printf("%-8s %2u producers  %6.2f M pushes/s  %5.1f%% popped,"
+		" %5.1f%% dropped\n", name, producers, r.pushes_per_s / 1e6,
+		100.0 * r.popped / (r.popped + r.dropped),
+		100.0 * r.dropped / (r.popped + r.dropped));
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max_producers = DEFAULT_PRODUCERS;
+	size_t count = DEFAULT_COUNT;
+	size_t capacity = DEFAULT_CAPACITY;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+
+		if (arg == "--producers" && i + 1 < argc) {
+			max_producers = (unsigned) strtoul(argv[++i], NULL, 10);
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = (size_t) strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--capacity" && i + 1 < argc) {
+			capacity = (size_t) strtoull(argv[++i], NULL, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--producers N] [--count N]"
+				" [--capacity N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	for (unsigned p = 1; p <= max_producers; p *= 2) {
+		MsgQueue<uint64_t> lock_free{capacity};
+		print("MsgQueue", p, run(lock_free, [](MsgQueue<uint64_t>& q, uint64_t v) {
+			q.push([&](uint64_t& slot) { slot = v; }, DropPolicy::OLDEST);
+		}, p, count));
+
+		LockedQueue locked{capacity};
+		print("mutex", p, run(locked, [](LockedQueue& q, uint64_t v) {
+			q.push(v);
+		}, p, count));
+	}
+
+	return 0;
+}
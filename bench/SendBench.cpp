@@ -0,0 +1,296 @@
+/*
+ * Micro-benchmark of framing and sending a sentence.
+ *
+ * Writes the same UTF-8 sentences to a blocking loopback socket, drained
+ * by a second thread, in three ways and reports MB/s of payload and heap
+ * allocations per message:
+ *   legacy    the original _send: a new buffer per message holding the
+ *             length and a copy of the payload, freed after send
+ *   vectored  length on the stack, header and payload as two buffers of
+ *             one WSASend/writev
+ *   framed    begin_frame/end_frame into a reused buffer as the I/O thread
+ *             does, one send per message
+ * UTF-16 conversion, which the original did per message as well, is left
+ * out here, utf_bench covers it.
+ *
+ * Usage: send_bench [--count N]
+ *   --count  Messages per variant, default 1000000
+ */
+
+#include "Frame.h"
+#include "Socket.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using clock_type = std::chrono::steady_clock;
+
+#define DEFAULT_COUNT 1000000
+#define DRAIN_BUF_LEN (64 * 1024)
+
+// Heap allocations of the whole process, see operator new below. The
+// array forms forward to it by default.
+static std::atomic<uint64_t> n_allocs{0};
+
+void* operator new(size_t n)
+{
+	n_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n ? n : 1))
+		return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+/**
+ * Send all of data on the blocking socket
+ */
+static bool send_all(SOCKET sock, char const* data, size_t len)
+{
+	while (len > 0) {
+		int sent = send(sock, data, (int) len, 0);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+/**
+ * The original _send, with strcpy_s replaced by the equivalent memcpy
+ */
+static bool send_legacy(SOCKET sock, string const& msg)
+{
+	int len = (int) msg.length();
+	int buf_len = len + 4;
+	char* buf = new char[buf_len + 1];
+
+	memcpy(buf + 4, msg.c_str(), len + 1);
+	*((uint32_t*) buf) = len;
+
+	bool ok = send_all(sock, buf, buf_len);
+	delete[] buf;
+	return ok;
+}
+
+/**
+ * Header and payload as two buffers of one call, continuing after partial
+ * writes
+ */
+static bool send_vectored(SOCKET sock, string const& msg)
+{
+	char header[4];
+	put_le32(header, (uint32_t) msg.size());
+
+	char const* parts[2] = {header, msg.data()};
+	size_t lens[2] = {sizeof(header), msg.size()};
+	size_t first = 0;
+
+	while (first < 2) {
+#ifdef _WIN32
+		WSABUF bufs[2];
+		DWORD n_bufs = 0, sent = 0;
+		for (size_t i = first; i < 2; ++i) {
+			bufs[n_bufs].buf = (char*) parts[i];
+			bufs[n_bufs].len = (ULONG) lens[i];
+			++n_bufs;
+		}
+		if (WSASend(sock, bufs, n_bufs, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+			return false;
+#else
+		iovec bufs[2];
+		int n_bufs = 0;
+		for (size_t i = first; i < 2; ++i) {
+			bufs[n_bufs].iov_base = (void*) parts[i];
+			bufs[n_bufs].iov_len = lens[i];
+			++n_bufs;
+		}
+		ssize_t sent = writev(sock, bufs, n_bufs);
+		if (sent <= 0)
+			return false;
+#endif
+		size_t left = (size_t) sent;
+		while (first < 2 && left >= lens[first])
+			left -= lens[first++];
+		if (first < 2) {
+			parts[first] += left;
+			lens[first] -= left;
+		}
+	}
+	return true;
+}
+
+/**
+ * A connected pair of blocking loopback sockets whose receiving end is
+ * read and discarded by a thread
+ */
+struct LoopbackPair {
+	SOCKET listen_sock = INVALID_SOCKET;
+	SOCKET out = INVALID_SOCKET;
+	SOCKET in = INVALID_SOCKET;
+	std::thread drain;
+	std::atomic<uint64_t> n_bytes{0};
+
+	bool open()
+	{
+		listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		out = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_sock == INVALID_SOCKET || out == INVALID_SOCKET)
+			return false;
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+
+		if (bind(listen_sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+				|| getsockname(listen_sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+				|| listen(listen_sock, 1) == SOCKET_ERROR
+				|| connect(out, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR)
+			return false;
+
+		in = accept(listen_sock, NULL, NULL);
+		if (in == INVALID_SOCKET)
+			return false;
+		set_nodelay(out);
+
+		drain = std::thread{[this] {
+			std::vector<char> buf(DRAIN_BUF_LEN);
+			int got;
+			while ((got = recv(in, buf.data(), (int) buf.size(), 0)) > 0)
+				n_bytes.fetch_add(got, std::memory_order_relaxed);
+		}};
+		return true;
+	}
+
+	/**
+	 * Close the sending end and wait until everything sent was read
+	 */
+	void close()
+	{
+		if (out != INVALID_SOCKET)
+			close_socket(out);
+		if (drain.joinable())
+			drain.join();
+		if (in != INVALID_SOCKET)
+			close_socket(in);
+		if (listen_sock != INVALID_SOCKET)
+			close_socket(listen_sock);
+	}
+};
+
+template <typename Send>
+static bool run(char const* name, std::vector<string> const& msgs,
+	size_t count, Send send_msg)
+{
+	LoopbackPair pair;
+	if (!pair.open()) {
+		fprintf(stderr, "Could not connect on loopback\n");
+		pair.close();
+		return false;
+	}
+
+	size_t payload = 0;
+	bool ok = true;
+	uint64_t allocs_before = n_allocs.load();
+	auto start = clock_type::now();
+
+	for (size_t i = 0; i < count && ok; ++i) {
+		string const& msg = msgs[i % msgs.size()];
+		ok = send_msg(pair.out, msg);
+		payload += msg.size();
+	}
+
+	uint64_t allocs = n_allocs.load() - allocs_before;
+	pair.close();
+	double s = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	if (!ok) {
+		fprintf(stderr, "%s: send failed\n", name);
+		return false;
+	}
+	printf("%-9s %7.1f MB/s payload  %7.1f MB/s on the wire  %.3f"
+		" allocations per message\n", name, payload / s / 1e6,
+		pair.n_bytes.load() / s / 1e6, (double) allocs / count);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = DEFAULT_COUNT;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+
+		if (arg == "--count" && i + 1 < argc) {
+			count = (size_t) strtoull(argv[++i], NULL, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--count N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	// Mixed Japanese and ASCII lines of typical length, in UTF-8
+	string const parts[] = {
+		u8"「それじゃあ、また明日」",
+		"Chapter 3: The Lighthouse",
+		u8"彼女は何も言わずに窓の外を見つめていた。",
+		u8"【アリス】",
+	};
+	std::vector<string> msgs;
+	for (int i = 0; i < 64; ++i) {
+		string s;
+		for (int j = 0; j <= i % 5; ++j)
+			s += parts[(i + j) % 4];
+		msgs.push_back(s + std::to_string(i));
+	}
+
+	string buf;
+	SentenceMeta meta{};
+	buf.reserve(4096);
+
+	bool ok = run("legacy", msgs, count, send_legacy)
+		&& run("vectored", msgs, count, send_vectored)
+		&& run("framed", msgs, count, [&](SOCKET sock, string const& msg) {
+			buf.clear();
+			size_t off = begin_frame(buf, FRAME_VERSION_LEGACY);
+			buf += msg;
+			end_frame(buf, off, FRAME_VERSION_LEGACY, 0, meta);
+			return send_all(sock, buf.data(), buf.size());
+		});
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return ok ? 0 : 1;
+}
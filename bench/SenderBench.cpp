@@ -0,0 +1,351 @@
+/*
+ * Loopback benchmark of the sender core.
+ *
+ * Replays a trace of sentences through Sender::submit, as Textractor's hook
+ * threads would, to a receiver stub on 127.0.0.1 and reports enqueue to
+ * receive latency, throughput, queue drops and heap allocations per
+ * sentence, as well as bytes on the wire against the uncompressed stream
+ * and CPU time of the I/O thread, to weigh Compression=1. Frames use
+ * version 2, whose header carries the enqueue time.
+ *
+ * Usage: sender_bench [--trace FILE] [--rate N] [--count N] [Key=Value ...]
+ *   --trace  UTF-8 text file, one sentence per line. Default: generated
+ *   --rate   Sentences per second, 0 submits as fast as possible (default)
+ *   --count  Sentences to submit, default 100000
+ * Key=Value pairs are tcpsender.config entries, e.g. AckMode=1.
+ */
+
+#include "Config.h"
+#include "Frame.h"
+#include "Log.h"
+#include "Sender.h"
+#include "Session.h"
+#include "Socket.h"
+#include "Utf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::wstring;
+using clock_type = std::chrono::steady_clock;
+
+#define DEFAULT_COUNT 100000
+#define CONNECT_WAIT_MS 5000
+#define DRAIN_WAIT_MS 10000
+
+// Heap allocations of the whole process, see operator new below
+static std::atomic<uint64_t> n_allocs{0};
+
+void* operator new(size_t n)
+{
+	n_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n ? n : 1))
+		return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void log(string const& msg)
+{
+	fprintf(stderr, "%s\n", msg.c_str());
+}
+
+void log(wstring const& msg)
+{
+	log(to_utf8(msg));
+}
+
+static uint64_t now_us()
+{
+	return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * CPU time used by the calling thread in milliseconds
+ */
+static double thread_cpu_ms()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+		return 0;
+	auto ticks = [](FILETIME const& t) {
+		return ((uint64_t) t.dwHighDateTime << 32) | t.dwLowDateTime;
+	};
+	return (ticks(kernel) + ticks(user)) / 1e4;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0;
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+#endif
+}
+
+/**
+ * Accepts one connection and records the latency of every frame from the
+ * capture time in its header. Session acks each read in ack mode and
+ * decompresses if zstd is built in and the sender offers it.
+ */
+struct ReceiverStub {
+	SOCKET listen_sock = INVALID_SOCKET;
+	SOCKET sock = INVALID_SOCKET;
+	uint16_t port = 0;
+
+	std::vector<uint32_t> latencies_us;
+	std::atomic<uint64_t> n_frames{0};
+	std::atomic<uint64_t> n_bytes{0};
+	std::atomic<uint64_t> n_decoded{0};
+
+	bool listen(size_t expected)
+	{
+		latencies_us.reserve(expected);
+
+		listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_sock == INVALID_SOCKET)
+			return false;
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+
+		if (bind(listen_sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+				|| getsockname(listen_sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+				|| ::listen(listen_sock, 1) == SOCKET_ERROR)
+			return false;
+
+		port = ntohs(addr.sin_port);
+		return true;
+	}
+
+	void run()
+	{
+		sock = accept(listen_sock, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			return;
+
+		Session session{sock, (uint8_t) (HELLO_FLAG_ACK
+			| (Session::decompression_available() ? HELLO_FLAG_ZSTD : 0))};
+		while (session.poll([&](ReceivedFrame const& f) {
+			uint64_t now = now_us();
+			uint64_t ts = f.meta.timestamp_us;
+			latencies_us.push_back((uint32_t) (now > ts ? now - ts : 0));
+			n_frames.fetch_add(1, std::memory_order_release);
+		})) {
+			n_bytes.store(session.bytes_received(), std::memory_order_relaxed);
+			n_decoded.store(session.bytes_decoded(), std::memory_order_relaxed);
+		}
+	}
+
+	void close()
+	{
+		if (sock != INVALID_SOCKET)
+			close_socket(sock);
+		if (listen_sock != INVALID_SOCKET)
+			close_socket(listen_sock);
+	}
+};
+
+static std::vector<wstring> load_trace(char const* filepath)
+{
+	std::vector<wstring> trace;
+
+	if (filepath == NULL) {
+		// Mixed Japanese and ASCII lines of typical length
+		wstring const parts[] = {
+			L"「それじゃあ、また明日」",
+			L"Chapter 3: The Lighthouse",
+			L"彼女は何も言わずに窓の外を見つめていた。",
+			L"【アリス】",
+		};
+		for (int i = 0; i < 64; ++i) {
+			wstring s;
+			for (int j = 0; j <= i % 5; ++j)
+				s += parts[(i + j) % 4];
+			trace.push_back(s + std::to_wstring(i));
+		}
+		return trace;
+	}
+
+	std::ifstream f{filepath, std::ios_base::binary};
+	string line;
+	while (std::getline(f, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			trace.push_back(to_utf16(line));
+	}
+	return trace;
+}
+
+static uint32_t percentile(std::vector<uint32_t> const& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = std::min(sorted.size() - 1, (size_t) (p * sorted.size()));
+	return sorted[i];
+}
+
+int main(int argc, char** argv)
+{
+	char const* trace_path = NULL;
+	unsigned rate = 0;
+	size_t count = DEFAULT_COUNT;
+
+	Config cfg;
+	cfg.log_level = LogLevel::ERR;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+
+		if (arg == "--trace" && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (arg == "--rate" && i + 1 < argc) {
+			rate = (unsigned) strtoul(argv[++i], NULL, 10);
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = (size_t) strtoull(argv[++i], NULL, 10);
+		} else if (eq != string::npos) {
+			set_config_entry(cfg, to_utf16(arg.substr(0, eq)),
+				to_utf16(arg.substr(eq + 1)));
+		} else {
+			fprintf(stderr, "Usage: %s [--trace FILE] [--rate N]"
+				" [--count N] [Key=Value ...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	std::vector<wstring> trace = load_trace(trace_path);
+	if (trace.empty()) {
+		fprintf(stderr, "Trace is empty\n");
+		return 1;
+	}
+
+	ReceiverStub stub;
+	if (!stub.listen(count)) {
+		fprintf(stderr, "Could not listen on loopback\n");
+		return 1;
+	}
+	std::thread stub_thread{[&] { stub.run(); }};
+
+	// The header timestamp needs version 2. Compression=1 takes effect if
+	// zstd is built in.
+	cfg.remote = L"127.0.0.1:" + std::to_wstring(stub.port);
+	cfg.connect = true;
+	cfg.frame_version = FRAME_VERSION_2;
+
+	// Compression, batching and sending all happen on the I/O thread
+	Sender sender{[] {}};
+	double io_cpu_ms = 0;
+	std::thread io_thread{[&] {
+		sender.run();
+		io_cpu_ms = thread_cpu_ms();
+	}};
+	sender.configure(cfg, std::filesystem::current_path());
+
+	auto connect_deadline = clock_type::now()
+		+ std::chrono::milliseconds{CONNECT_WAIT_MS};
+	while (sender.status(0).state != ConnState::CONNECTED) {
+		if (clock_type::now() > connect_deadline) {
+			fprintf(stderr, "Could not connect to the receiver stub\n");
+			std::exit(1);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+
+	// Submit on this thread like a hook thread would, paced if asked to
+	uint64_t allocs_before = n_allocs.load();
+	auto start = clock_type::now();
+	auto interval = std::chrono::nanoseconds{rate > 0 ? 1000000000 / rate : 0};
+
+	for (size_t i = 0; i < count; ++i) {
+		if (rate > 0) {
+			auto due = start + interval * i;
+			while (clock_type::now() < due)
+				std::this_thread::yield();
+		}
+		wstring const& s = trace[i % trace.size()];
+		sender.submit(s.c_str(), true, NULL, 1, 0);
+	}
+	auto submitted = clock_type::now();
+
+	// Wait until everything not dropped arrived
+	auto drain_deadline = clock_type::now()
+		+ std::chrono::milliseconds{DRAIN_WAIT_MS};
+	while (stub.n_frames.load(std::memory_order_acquire) + sender.dropped()
+			< count && clock_type::now() < drain_deadline)
+		std::this_thread::sleep_for(std::chrono::microseconds{100});
+	auto done = clock_type::now();
+	uint64_t allocs = n_allocs.load() - allocs_before;
+
+	sender.stop();
+	io_thread.join();
+	stub_thread.join();
+	stub.close();
+
+	uint64_t received = stub.n_frames.load(std::memory_order_acquire);
+	std::vector<uint32_t> lat = stub.latencies_us;
+	std::sort(lat.begin(), lat.end());
+
+	double submit_s = std::chrono::duration<double>(submitted - start).count();
+	double total_s = std::chrono::duration<double>(done - start).count();
+
+	printf("sentences   %zu submitted, %llu received, %llu dropped\n", count,
+		(unsigned long long) received,
+		(unsigned long long) sender.dropped());
+	printf("throughput  %.0f sentences/s submitted, %.0f sentences/s"
+		" received, %.1f MB/s\n", count / submit_s, received / total_s,
+		stub.n_bytes.load() / total_s / 1e6);
+	printf("latency us  p50 %u, p99 %u, p999 %u, max %u\n",
+		percentile(lat, 0.5), percentile(lat, 0.99), percentile(lat, 0.999),
+		lat.empty() ? 0 : lat.back());
+	printf("allocations %.3f per sentence\n", (double) allocs / count);
+
+	uint64_t wire = stub.n_bytes.load(), decoded = stub.n_decoded.load();
+	printf("bytes       %llu on the wire, %llu uncompressed (%.1f%%)\n",
+		(unsigned long long) wire, (unsigned long long) decoded,
+		decoded > 0 ? 100.0 * wire / decoded : 100.0);
+	printf("cpu         I/O thread %.1f ms, %.2f us per sentence received\n",
+		io_cpu_ms, received > 0 ? io_cpu_ms * 1000 / received : 0.0);
+
+	if (cfg.latency_trace) {
+		for (size_t i = 0; i < (size_t) Stage::COUNT; ++i)
+			printf("stage       %s\n",
+				sender.stage_trace().summary((Stage) i).c_str());
+	}
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return received + sender.dropped() >= count ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "FrameParser.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Move the remainder to the front rather than read less than this
+#define FRAME_PARSER_MIN_READ 4096
+
+FrameParser::FrameParser(int version, size_t capacity)
+	: buf(new char[capacity]), cap(capacity), version(version)
+{
+}
+
+void FrameParser::reset(int version)
+{
+	head = 0;
+	tail = 0;
+	seq = 0;
+	bad = false;
+	this->version = version;
+}
+
+char* FrameParser::prepare(size_t& len)
+{
+	// Everything parsed, start over at the front for free
+	if (head == tail)
+		head = tail = 0;
+
+	size_t have = tail - head;
+	size_t need = FRAME_PARSER_MIN_READ;
+	if (have >= 4) {
+		size_t frame_len = 4 + (size_t) get_le32(data());
+		if (frame_len > have && frame_len <= 4 + FRAME_PARSER_MAX_FRAME)
+			need = std::max(need, frame_len - have);
+	}
+
+	if (cap - tail < need) {
+		if (have + need <= cap) {
+			memmove(buf.get(), buf.get() + head, have);
+		} else {
+			// A single frame larger than the buffer
+			size_t new_cap = cap;
+			while (new_cap < have + need)
+				new_cap *= 2;
+
+			std::unique_ptr<char[]> bigger{new char[new_cap]};
+			memcpy(bigger.get(), buf.get() + head, have);
+			buf = std::move(bigger);
+			cap = new_cap;
+		}
+		head = 0;
+		tail = have;
+	}
+
+	len = cap - tail;
+	return buf.get() + tail;
+}
+
+bool FrameParser::next(ReceivedFrame& frame)
+{
+	while (!bad && tail - head >= 4) {
+		char const* p = data();
+		uint32_t len = get_le32(p);
+
+		if (len > FRAME_PARSER_MAX_FRAME) {
+			bad = true;
+			break;
+		}
+		if (tail - head < 4 + (size_t) len)
+			break;
+		head += 4 + (size_t) len;
+
+		if (version < FRAME_VERSION_2) {
+			frame.seq = ++seq;
+			frame.meta = SentenceMeta{};
+			frame.text = std::string_view{p + 4, len};
+			return true;
+		}
+
+		// Header length covers the fields up to the payload, later
+		// versions may add fields behind the ones known here
+		if (len < FRAME_V2_HEADER_LEN) {
+			bad = true;
+			break;
+		}
+		uint16_t header_len = (uint16_t) ((unsigned char) p[6]
+			| ((unsigned char) p[7] << 8));
+		if (header_len < FRAME_V2_HEADER_LEN || header_len > len) {
+			bad = true;
+			break;
+		}
+
+		// Skip frame types other than sentences
+		if (p[5] != FRAME_TYPE_SENTENCE)
+			continue;
+
+		frame.seq = seq = get_le64(p + 8);
+		frame.meta.timestamp_us = get_le64(p + 16);
+		frame.meta.text_number = get_le32(p + 24);
+		frame.meta.process_id = get_le32(p + 28);
+		frame.text = std::string_view{p + 4 + header_len, len - header_len};
+		return true;
+	}
+
+	return false;
+}
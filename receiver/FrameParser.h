@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Frame.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#define FRAME_PARSER_INITIAL_CAP (64 * 1024)
+
+// Larger frames are treated as a corrupt stream
+#define FRAME_PARSER_MAX_FRAME (16 * 1024 * 1024)
+
+/**
+ * Sentence frame as received. text points into the parser's buffer and is
+ * valid until the next prepare().
+ */
+struct ReceivedFrame {
+	// Version 2 sequence number. Legacy frames are counted from 1 per
+	// connection, which is what acks refer to there.
+	uint64_t seq = 0;
+
+	// Zero for legacy frames
+	SentenceMeta meta;
+
+	// UTF-8, not null terminated
+	std::string_view text;
+};
+
+/**
+ * Splits the byte stream of one connection into frames without copying
+ * payloads.
+ *
+ * Data is received straight into the free end of a single buffer with
+ * prepare()/commit() and complete frames are handed out in place by
+ * next(). The buffer is reused ring-like: consumed space at the front is
+ * reclaimed once the end is reached by moving the unparsed remainder,
+ * never more than one partial frame, to the front. It only grows when a
+ * single frame does not fit.
+ */
+class FrameParser {
+public:
+	explicit FrameParser(int version = FRAME_VERSION_2,
+		size_t capacity = FRAME_PARSER_INITIAL_CAP);
+
+	/**
+	 * Drop all buffered data and start over, e.g. for a new connection
+	 */
+	void reset(int version);
+
+	/**
+	 * Frame version of the data after what was already parsed
+	 */
+	void set_version(int version) { this->version = version; }
+
+	/**
+	 * Writable space behind the buffered data, len receives its size.
+	 * Invalidates frames returned so far.
+	 */
+	char* prepare(size_t& len);
+
+	/**
+	 * Append the first n bytes written to the space from prepare()
+	 */
+	void commit(size_t n) { tail += n; }
+
+	/**
+	 * Take the next complete frame. Returns false if more data is needed
+	 * or the stream is corrupt, see failed().
+	 */
+	bool next(ReceivedFrame& frame);
+
+	/**
+	 * Call on_frame(ReceivedFrame const&) for each complete frame.
+	 * Returns the number of frames.
+	 */
+	template <typename F>
+	size_t parse(F&& on_frame)
+	{
+		ReceivedFrame frame;
+		size_t n = 0;
+		while (next(frame)) {
+			on_frame(frame);
+			++n;
+		}
+		return n;
+	}
+
+	bool failed() const { return bad; }
+
+	/**
+	 * Sequence number of the last frame taken, 0 if none
+	 */
+	uint64_t last_seq() const { return seq; }
+
+	// Unparsed bytes, e.g. to look at a hello before the first frame
+	char const* data() const { return buf.get() + head; }
+	size_t available() const { return tail - head; }
+	void consume(size_t n) { head += n; }
+
+private:
+	std::unique_ptr<char[]> buf;
+	size_t cap;
+	size_t head = 0;  // Start of unparsed data
+	size_t tail = 0;  // End of received data
+
+	int version;
+	uint64_t seq = 0;
+	bool bad = false;
+};
@@ -0,0 +1,152 @@
+#include "Session.h"
+#include "AckWindow.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef TCPSENDER_ZSTD
+#include <zstd.h>
+#endif
+
+#define SESSION_RAW_LEN (64 * 1024)
+
+Session::Session(SOCKET sock, uint8_t accept_flags, bool ack_legacy)
+	: sock(sock), accept_flags(accept_flags), ack_legacy(ack_legacy)
+{
+	if (!decompression_available())
+		this->accept_flags &= ~HELLO_FLAG_ZSTD;
+}
+
+Session::~Session()
+{
+#ifdef TCPSENDER_ZSTD
+	ZSTD_freeDCtx((ZSTD_DCtx*) dctx);
+#endif
+}
+
+bool Session::decompression_available()
+{
+#ifdef TCPSENDER_ZSTD
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Send all of data on the blocking socket
+ */
+static bool send_all(SOCKET sock, char const* data, size_t len)
+{
+	while (len > 0) {
+		int sent = send(sock, data, (int) len, 0);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+bool Session::receive()
+{
+	size_t len;
+	char* p;
+
+	if (!decompressing) {
+		p = parser.prepare(len);
+		int got = recv(sock, p, (int) len, 0);
+		if (got <= 0)
+			return false;
+		n_received += got;
+		n_decoded += got;
+		parser.commit(got);
+		return true;
+	}
+
+#ifdef TCPSENDER_ZSTD
+	int got = recv(sock, raw.data(), (int) raw.size(), 0);
+	if (got <= 0)
+		return false;
+	n_received += got;
+
+	// The sender flushes after every write, so everything read decodes
+	// right away. Keep going while the output space runs full.
+	ZSTD_inBuffer in{raw.data(), (size_t) got, 0};
+	for (;;) {
+		p = parser.prepare(len);
+		ZSTD_outBuffer out{p, len, 0};
+		size_t res = ZSTD_decompressStream((ZSTD_DCtx*) dctx, &out, &in);
+		if (ZSTD_isError(res))
+			return false;
+		n_decoded += out.pos;
+		parser.commit(out.pos);
+
+		if (in.pos == in.size && out.pos < out.size)
+			return true;
+	}
+#else
+	return false;
+#endif
+}
+
+/**
+ * Look at the first bytes to tell a hello from a legacy frame and answer
+ * the hello. Returns false if more data is needed or the hello could not
+ * be answered.
+ */
+bool Session::start()
+{
+	if (parser.available() < 4)
+		return false;
+
+	if (memcmp(parser.data(), HELLO_MAGIC, 4) != 0) {
+		// A legacy frame of this length would be over 1 GB
+		started = true;
+		frame_version = FRAME_VERSION_LEGACY;
+		parser.set_version(FRAME_VERSION_LEGACY);
+		acking = ack_legacy;
+		return true;
+	}
+
+	if (parser.available() < HELLO_LEN)
+		return false;
+
+	uint8_t version, flags;
+	parse_hello(parser.data(), version, flags);
+	parser.consume(HELLO_LEN);
+
+	// Senders check the version and the flags they need in the reply
+	agreed_flags = flags & accept_flags;
+	std::string reply;
+	append_hello(reply, FRAME_VERSION_2, agreed_flags);
+	if (!send_all(sock, reply.data(), reply.size()))
+		return false;
+
+	started = true;
+	frame_version = FRAME_VERSION_2;
+	parser.set_version(FRAME_VERSION_2);
+	acking = (agreed_flags & HELLO_FLAG_ACK) != 0;
+
+#ifdef TCPSENDER_ZSTD
+	if (agreed_flags & HELLO_FLAG_ZSTD) {
+		if (!dctx)
+			dctx = ZSTD_createDCtx();
+		if (!dctx)
+			return false;
+		ZSTD_DCtx_reset((ZSTD_DCtx*) dctx, ZSTD_reset_session_only);
+		raw.resize(SESSION_RAW_LEN);
+		decompressing = true;
+	}
+#endif
+
+	(void) version;
+	return true;
+}
+
+void Session::send_ack()
+{
+	char ack[ACK_LEN];
+	put_le64(ack, parser.last_seq());
+	send_all(sock, ack, ACK_LEN);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Frame.h"
+#include "FrameParser.h"
+#include "Socket.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Receiving end of one connection from TCPSender over a blocking socket.
+ *
+ * Detects the frame version from the first bytes: a hello starts the
+ * version 2 handshake, anything else is a legacy stream. Answers the
+ * hello with the subset of its flags given as accept_flags and sends
+ * cumulative acks after every read if acks were agreed on.
+ */
+class Session {
+public:
+	/**
+	 * accept_flags are the HELLO_FLAG_s to accept if offered. ack_legacy
+	 * sends acks to legacy senders too, which need them in ack mode and
+	 * ignore them otherwise.
+	 */
+	explicit Session(SOCKET sock, uint8_t accept_flags = HELLO_FLAG_ACK,
+		bool ack_legacy = false);
+	~Session();
+
+	Session(Session const&) = delete;
+	Session& operator=(Session const&) = delete;
+
+	/**
+	 * Receive once and call on_frame(ReceivedFrame const&) for every frame
+	 * completed by the read. Returns false once the connection is closed
+	 * or the stream is corrupt.
+	 */
+	template <typename F>
+	bool poll(F&& on_frame)
+	{
+		if (!receive())
+			return false;
+		if (!started && !start())
+			return !parser.failed();
+
+		size_t n = parser.parse(on_frame);
+		if (parser.failed())
+			return false;
+		if (n > 0 && acking)
+			send_ack();
+		return true;
+	}
+
+	// Known once the first bytes arrived
+	int version() const { return frame_version; }
+	uint8_t flags() const { return agreed_flags; }
+
+	/**
+	 * Bytes read from the socket so far, compressed if zstd was agreed on
+	 */
+	uint64_t bytes_received() const { return n_received; }
+
+	/**
+	 * Bytes of the frame stream so far, after decompression
+	 */
+	uint64_t bytes_decoded() const { return n_decoded; }
+
+	/**
+	 * True if HELLO_FLAG_ZSTD can be accepted, i.e. zstd was available at
+	 * build time
+	 */
+	static bool decompression_available();
+
+private:
+	bool receive();
+	bool start();
+	void send_ack();
+
+	SOCKET sock;
+	FrameParser parser;
+	uint8_t accept_flags;
+	bool ack_legacy;
+
+	bool started = false;
+	int frame_version = FRAME_VERSION_LEGACY;
+	uint8_t agreed_flags = 0;
+	bool acking = false;
+	uint64_t n_received = 0;
+	uint64_t n_decoded = 0;
+
+	// zstd stream if agreed on, compressed input is read into raw
+	void* dctx = nullptr;
+	bool decompressing = false;
+	std::vector<char> raw;
+};
@@ -0,0 +1,129 @@
+/*
+ * Loopback test server for TCPSender.
+ *
+ * Accepts connections and prints every sentence received, one line each,
+ * with its sequence number and, for version 2 frames, the text number and
+ * process id. Accepts acks and, if built with zstd, compression.
+ *
+ * Usage: test_server [--port N] [--any]
+ *   --port  Port to listen on, default 30501
+ *   --any   Listen on all interfaces instead of 127.0.0.1 only
+ */
+
+#include "Log.h"
+#include "Session.h"
+#include "Utf.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define DEFAULT_PORT 30501
+
+static std::mutex out_mut;
+
+void log(std::string const& msg)
+{
+	std::lock_guard<std::mutex> lk{out_mut};
+	fprintf(stderr, "%s\n", msg.c_str());
+}
+
+void log(std::wstring const& msg)
+{
+	log(to_utf8(msg));
+}
+
+static void serve(SOCKET sock, unsigned id)
+{
+	uint8_t accept = HELLO_FLAG_ACK;
+	if (Session::decompression_available())
+		accept |= HELLO_FLAG_ZSTD;
+
+	Session session{sock, accept, true};
+	bool announced = false;
+
+	while (session.poll([&](ReceivedFrame const& f) {
+		std::lock_guard<std::mutex> lk{out_mut};
+		if (session.version() >= FRAME_VERSION_2) {
+			printf("#%llu [text %u pid %u] %.*s\n",
+				(unsigned long long) f.seq, f.meta.text_number,
+				f.meta.process_id, (int) f.text.size(), f.text.data());
+		} else {
+			printf("#%llu %.*s\n", (unsigned long long) f.seq,
+				(int) f.text.size(), f.text.data());
+		}
+		fflush(stdout);
+	})) {
+		if (!announced && session.version() != FRAME_VERSION_LEGACY) {
+			std::lock_guard<std::mutex> lk{out_mut};
+			fprintf(stderr, "Connection %u: version %d, flags %u\n", id,
+				session.version(), session.flags());
+			announced = true;
+		}
+	}
+
+	std::lock_guard<std::mutex> lk{out_mut};
+	fprintf(stderr, "Connection %u closed\n", id);
+	close_socket(sock);
+}
+
+int main(int argc, char** argv)
+{
+	uint16_t port = DEFAULT_PORT;
+	bool any = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			port = (uint16_t) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--any") == 0) {
+			any = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--port N] [--any]\n", argv[0]);
+			return 2;
+		}
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	SOCKET listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listen_sock == INVALID_SOCKET)
+		return 1;
+
+	int on = 1;
+	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, (char const*) &on,
+		sizeof(on));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(any ? INADDR_ANY : INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (bind(listen_sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| listen(listen_sock, SOMAXCONN) == SOCKET_ERROR) {
+		fprintf(stderr, "Could not listen on port %u\n", port);
+		close_socket(listen_sock);
+		return 1;
+	}
+	fprintf(stderr, "Listening on port %u\n", port);
+
+	for (unsigned id = 1;; ++id) {
+		SOCKET sock = accept(listen_sock, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			break;
+		std::thread{serve, sock, id}.detach();
+	}
+
+	close_socket(listen_sock);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return 0;
+}
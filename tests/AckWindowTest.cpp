@@ -0,0 +1,125 @@
+/*
+ * Unit tests of the window of unacknowledged frames in ack mode
+ */
+
+#include "AckWindow.h"
+#include "Check.h"
+#include "Frame.h"
+
+#include <string>
+
+using std::string;
+
+/**
+ * Batch of n frames numbered from seq, each text "line <seq>"
+ */
+static string batch(int version, uint64_t seq, size_t n)
+{
+	string buf;
+	for (size_t i = 0; i < n; ++i) {
+		size_t off = begin_frame(buf, version);
+		buf += "line " + std::to_string(seq + i);
+		end_frame(buf, off, version, seq + i, SentenceMeta{});
+	}
+	return buf;
+}
+
+static string window_data(AckWindow const& window)
+{
+	return string{window.data(), window.bytes()};
+}
+
+static void test_partial_ack()
+{
+	AckWindow window;
+	string first = batch(FRAME_VERSION_2, 1, 3);
+	string second = batch(FRAME_VERSION_2, 4, 2);
+	window.push(first.data(), first.size(), 1);
+	window.push(second.data(), second.size(), 4);
+	CHECK(window.size() == 5);
+	CHECK(window_data(window) == first + second);
+
+	// An ack within a batch releases the frames up to it
+	CHECK(window.ack(2) == 2);
+	CHECK(window.size() == 3);
+	CHECK(window_data(window) == batch(FRAME_VERSION_2, 3, 1) + second);
+
+	// Repeated and older acks release nothing
+	CHECK(window.ack(2) == 0);
+	CHECK(window.ack(1) == 0);
+	CHECK(window.size() == 3);
+
+	// Acks split across reads
+	char ack[ACK_LEN];
+	put_le64(ack, 4);
+	CHECK(window.feed(ack, 3) == 0);
+	CHECK(window.feed(ack + 3, ACK_LEN - 3) == 2);
+	CHECK(window_data(window) == batch(FRAME_VERSION_2, 5, 1));
+
+	// Several acks in one read
+	char acks[2 * ACK_LEN];
+	put_le64(acks, 4);
+	put_le64(acks + ACK_LEN, 5);
+	CHECK(window.feed(acks, sizeof(acks)) == 1);
+	CHECK(window.empty());
+	CHECK(window.bytes() == 0);
+}
+
+static void test_renumber()
+{
+	// Legacy frames are counted per connection
+	AckWindow window;
+	string frames = batch(FRAME_VERSION_LEGACY, 1, 4);
+	window.push(frames.data(), frames.size(), 1);
+	CHECK(window.ack(1) == 1);
+
+	// Half an ack from the old connection is discarded on reconnect
+	char ack[ACK_LEN];
+	put_le64(ack, 3);
+	CHECK(window.feed(ack, 4) == 0);
+	window.restart();
+
+	// The new connection counts the resent frames from 1
+	window.renumber(1);
+	CHECK(window_data(window) == frames.substr(
+		batch(FRAME_VERSION_LEGACY, 1, 1).size()));
+
+	put_le64(ack, 2);
+	CHECK(window.feed(ack, ACK_LEN) == 2);
+	CHECK(window.size() == 1);
+	CHECK(window_data(window) == batch(FRAME_VERSION_LEGACY, 4, 1));
+
+	// New frames follow the renumbered ones
+	string more = batch(FRAME_VERSION_LEGACY, 5, 1);
+	window.push(more.data(), more.size(), 4);
+	CHECK(window.ack(3) == 1);
+	CHECK(window.ack(4) == 1);
+	CHECK(window.empty());
+}
+
+static void test_ack_beyond()
+{
+	AckWindow window;
+	string frames = batch(FRAME_VERSION_2, 10, 3);
+	window.push(frames.data(), frames.size(), 10);
+
+	// An ack past the newest frame releases the whole window and no more
+	CHECK(window.ack(1000) == 3);
+	CHECK(window.empty());
+	CHECK(window.ack(1001) == 0);
+
+	// The window starts over at the next frame pushed
+	string more = batch(FRAME_VERSION_2, 13, 2);
+	window.push(more.data(), more.size(), 13);
+	CHECK(window.ack(12) == 0);
+	CHECK(window.ack(13) == 1);
+	CHECK(window_data(window) == batch(FRAME_VERSION_2, 14, 1));
+}
+
+int main()
+{
+	test_partial_ack();
+	test_renumber();
+	test_ack_beyond();
+	return check_result();
+}
@@ -0,0 +1,107 @@
+/*
+ * Unit tests of the reconnect delay schedule
+ */
+
+#include "Backoff.h"
+#include "Check.h"
+#include "Config.h"
+
+#include <chrono>
+#include <limits>
+
+#define TEST_SAMPLES 1000
+
+static long long next_ms(Backoff& backoff)
+{
+	return (long long) backoff.next_delay().count();
+}
+
+static void test_schedule()
+{
+	Backoff backoff;
+	backoff.configure(100, 2.0, 1000, 0);
+
+	// Grows by the multiplier until capped at max_ms
+	long long expected[] = {100, 200, 400, 800, 1000, 1000, 1000};
+	for (long long ms : expected)
+		CHECK(next_ms(backoff) == ms);
+	CHECK(backoff.attempts() == 7);
+
+	// reset() starts over
+	backoff.reset();
+	CHECK(backoff.attempts() == 0);
+	CHECK(next_ms(backoff) == 100);
+	CHECK(next_ms(backoff) == 200);
+
+	// max_ms below initial_ms never cuts the first delay
+	backoff.configure(500, 3.0, 100, 0);
+	backoff.reset();
+	CHECK(next_ms(backoff) == 500);
+	CHECK(next_ms(backoff) == 500);
+
+	// Multipliers below 1 would shrink the delay
+	backoff.configure(300, 0.5, 1000, 0);
+	backoff.reset();
+	CHECK(next_ms(backoff) == 300);
+	CHECK(next_ms(backoff) == 300);
+
+	// NaN keeps the delay constant too
+	backoff.configure(300, std::numeric_limits<double>::quiet_NaN(), 1000, 0);
+	backoff.reset();
+	CHECK(next_ms(backoff) == 300);
+	CHECK(next_ms(backoff) == 300);
+}
+
+static void test_config()
+{
+	Config cfg;
+	set_config_entry(cfg, L"ReconnectMultiplier", L"1.5");
+	CHECK(cfg.reconnect_multiplier == 1.5);
+
+	// Values that are not finite are ignored
+	for (wchar_t const* val : {L"nan", L"NAN", L"inf", L"-infinity", L"1e999",
+			L"", L"2x"}) {
+		set_config_entry(cfg, L"ReconnectMultiplier", val);
+		CHECK(cfg.reconnect_multiplier == 1.5);
+	}
+}
+
+static void test_jitter()
+{
+	Backoff backoff;
+	backoff.configure(1000, 2.0, 8000, 20);
+
+	// Every delay stays within +-20% of the schedule, less rounding down,
+	// and they differ
+	bool varied = false;
+	long long first = -1;
+	for (int i = 0; i < TEST_SAMPLES; ++i) {
+		backoff.reset();
+		long long base = 1000;
+		for (int j = 0; j < 5; ++j) {
+			long long ms = next_ms(backoff);
+			CHECK(ms >= base * 8 / 10 - 1 && ms <= base * 12 / 10);
+			if (j == 0) {
+				varied = varied || (first >= 0 && ms != first);
+				first = ms;
+			}
+			base = base * 2 > 8000 ? 8000 : base * 2;
+		}
+	}
+	CHECK(varied);
+
+	// Jitter above 100% is clamped, delays never go negative
+	backoff.configure(100, 2.0, 100, 500);
+	for (int i = 0; i < TEST_SAMPLES; ++i) {
+		long long ms = next_ms(backoff);
+		CHECK(ms >= 0 && ms <= 200);
+	}
+}
+
+int main()
+{
+	test_schedule();
+	test_jitter();
+	test_config();
+	return check_result();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Minimal checks for the unit tests, each test is one executable that
+ * returns non-zero if any check failed. Also provides the log() the core
+ * expects from its platform adapter, printing to stderr.
+ */
+
+#include "Utf.h"
+
+#include <cstdio>
+#include <string>
+
+static int check_failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#cond); \
+			++check_failures; \
+		} \
+	} while (0)
+
+void log(std::string const& msg)
+{
+	fprintf(stderr, "%s\n", msg.c_str());
+}
+
+void log(std::wstring const& msg)
+{
+	log(to_utf8(msg));
+}
+
+static int check_result()
+{
+	if (check_failures > 0)
+		fprintf(stderr, "%d checks failed\n", check_failures);
+	return check_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Unit tests of duplicate suppression and collapsing of repeated characters
+ * and lines
+ */
+
+#include "Check.h"
+#include "Dedup.h"
+#include "Utf.h"
+
+#include <cwchar>
+#include <string>
+
+using std::string;
+using std::wstring;
+
+/**
+ * The text the sender forwards for s with CollapseRepeats=1
+ */
+static wstring collapsed_chars(wstring const& s)
+{
+	size_t stride = repeat_factor(s.data(), s.size());
+	wstring out;
+	for (size_t i = 0; i < s.size(); i += stride)
+		out += s[i];
+
+	// The encoder keeps the same code units
+	string utf8(utf8_max_len(s.size()), '\0');
+	utf8.resize(collapse_to_utf8(s.data(), s.size(), stride, &utf8[0]));
+	CHECK(utf8 == to_utf8(out));
+	return out;
+}
+
+/**
+ * The text the sender forwards for s with CollapseRepeats=2
+ */
+static wstring collapsed_text(wstring const& s)
+{
+	return s.substr(0, repeat_period(s.data(), s.size()));
+}
+
+static void test_collapse_chars()
+{
+	// Every run equally long, one character per run is forwarded
+	CHECK(collapsed_chars(L"ここんんにに") == L"こんに");
+	CHECK(collapsed_chars(L"ここここ") == L"こ");
+	CHECK(collapsed_chars(L"「「ははいい」」") == L"「はい」");
+	CHECK(collapsed_chars(L"ccoouunntt") == L"count");
+	CHECK(collapsed_chars(L"ああああいいいい") == L"あい");
+
+	// Short lines are ordinary dialogue
+	CHECK(collapsed_chars(L"ああ") == L"ああ");
+	CHECK(collapsed_chars(L"……") == L"……");
+	CHECK(collapsed_chars(L"ままま") == L"ままま");
+	CHECK(collapsed_chars(L"") == L"");
+
+	// Runs of different length, or single characters in between
+	CHECK(collapsed_chars(L"ああ、そうか") == L"ああ、そうか");
+	CHECK(collapsed_chars(L"ここここんん") == L"ここここんん");
+	CHECK(collapsed_chars(L"ここんんに") == L"ここんんに");
+	CHECK(collapsed_chars(L"こんにちはこんにちは") == L"こんにちはこんにちは");
+
+	// Long lines cross the encoder's chunks
+	wstring doubled, single;
+	for (int i = 0; i < 300; ++i) {
+		wchar_t c = i % 2 ? L'あ' : L'a';
+		doubled += c;
+		doubled += c;
+		single += c;
+	}
+	CHECK(collapsed_chars(doubled) == single);
+
+	// Both forms dedup against each other
+	wchar_t const* runs = L"ここんんにに";
+	CHECK(sentence_hash(runs, 6, 2, 1) == sentence_hash(L"こんに", 3, 1, 1));
+}
+
+static void test_collapse_text()
+{
+	// Repeated text is forwarded once, at its shortest repetition
+	CHECK(collapsed_text(L"こんにちはこんにちは") == L"こんにちは");
+	CHECK(collapsed_text(L"ここここ") == L"ここ");
+	CHECK(collapsed_text(L"abcabcabc") == L"abc");
+	CHECK(collapsed_text(L"「はい」「はい」") == L"「はい」");
+
+	// Short lines and runs of one character are ordinary dialogue
+	CHECK(collapsed_text(L"ああ") == L"ああ");
+	CHECK(collapsed_text(L"……") == L"……");
+	CHECK(collapsed_text(L"ままま") == L"ままま");
+	CHECK(collapsed_text(L"ーーーーー") == L"ーーーーー");
+	CHECK(collapsed_text(L"") == L"");
+
+	// Not a whole repetition
+	CHECK(collapsed_text(L"ああ、そうか") == L"ああ、そうか");
+	CHECK(collapsed_text(L"abcabcab") == L"abcabcab");
+}
+
+static void test_seen()
+{
+	Dedup dedup;
+	wchar_t const* a = L"彼女は窓の外を見た。";
+	wchar_t const* b = L"「それじゃあ」";
+	uint64_t ha = sentence_hash(a, wcslen(a), 1, 1);
+	uint64_t hb = sentence_hash(b, wcslen(b), 1, 1);
+
+	// Disabled by default
+	CHECK(!dedup.enabled());
+	CHECK(!dedup.seen(ha));
+	CHECK(!dedup.seen(ha));
+
+	dedup.configure(2, false);
+	CHECK(!dedup.seen(ha));
+	CHECK(dedup.seen(ha));
+	CHECK(!dedup.seen(hb));
+	CHECK(dedup.seen(ha));
+	CHECK(dedup.hits() == 2);
+
+	// Same text on another thread is not a duplicate
+	CHECK(sentence_hash(a, wcslen(a), 1, 2) != ha);
+
+	// Evicted once enough other lines went by
+	dedup.configure(1, false);
+	CHECK(!dedup.seen(hb));
+	CHECK(!dedup.seen(ha));
+	CHECK(!dedup.seen(hb));
+}
+
+int main()
+{
+	test_collapse_chars();
+	test_collapse_text();
+	test_seen();
+	return check_result();
+}
@@ -0,0 +1,147 @@
+/*
+ * Unit tests of the wire format: frame headers byte by byte, encoding and
+ * parsing them back, sentence metadata and the hello.
+ */
+
+#include "Check.h"
+#include "Frame.h"
+#include "FrameParser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using std::string;
+
+// Every byte differs, so swapped or shifted fields show
+#define TEST_SEQ 0x0807060504030201ull
+#define TEST_TIMESTAMP 0x1817161514131211ull
+#define TEST_TEXT_NUMBER 0x24232221u
+#define TEST_PROCESS_ID 0x34333231u
+
+static SentenceMeta test_meta()
+{
+	SentenceMeta meta;
+	meta.timestamp_us = TEST_TIMESTAMP;
+	meta.text_number = TEST_TEXT_NUMBER;
+	meta.process_id = TEST_PROCESS_ID;
+	return meta;
+}
+
+static string frame(int version, string const& text)
+{
+	string buf;
+	size_t off = begin_frame(buf, version);
+	buf += text;
+	end_frame(buf, off, version, TEST_SEQ, test_meta());
+	return buf;
+}
+
+static string bytes(std::initializer_list<unsigned char> list)
+{
+	return string{list.begin(), list.end()};
+}
+
+static void test_layout()
+{
+	string text = u8"はい";
+
+	// Legacy: length and payload
+	string v1 = frame(FRAME_VERSION_LEGACY, text);
+	CHECK(frame_payload_off(FRAME_VERSION_LEGACY) == 4);
+	CHECK(v1 == bytes({6, 0, 0, 0}) + text);
+
+	// Version 2: length of everything after it and the 28 byte header
+	string v2 = frame(FRAME_VERSION_2, text);
+	CHECK(frame_payload_off(FRAME_VERSION_2) == 4 + FRAME_V2_HEADER_LEN);
+	CHECK(v2.size() == 4 + FRAME_V2_HEADER_LEN + text.size());
+	CHECK(v2.substr(0, 4) == bytes({34, 0, 0, 0}));
+	CHECK(v2.substr(4, 4) == bytes({2, FRAME_TYPE_SENTENCE, 28, 0}));
+	CHECK(v2.substr(8, 8) == bytes({1, 2, 3, 4, 5, 6, 7, 8}));
+	CHECK(v2.substr(16, 8) == bytes({0x11, 0x12, 0x13, 0x14,
+		0x15, 0x16, 0x17, 0x18}));
+	CHECK(v2.substr(24, 4) == bytes({0x21, 0x22, 0x23, 0x24}));
+	CHECK(v2.substr(28, 4) == bytes({0x31, 0x32, 0x33, 0x34}));
+	CHECK(v2.substr(32) == text);
+
+	// Frames appended behind others
+	string buf = v1;
+	size_t off = begin_frame(buf, FRAME_VERSION_2);
+	CHECK(off == v1.size());
+	buf += text;
+	end_frame(buf, off, FRAME_VERSION_2, TEST_SEQ, test_meta());
+	CHECK(buf == v1 + v2);
+}
+
+static void test_round_trip(int version)
+{
+	string texts[] = {u8"「それじゃあ、また明日」", "", string(70000, 'x')};
+	string buf;
+	for (string const& text : texts)
+		buf += frame(version, text);
+
+	// The long frame does not fit the parser's initial buffer
+	FrameParser parser{version};
+	size_t i = 0;
+	for (size_t pos = 0; pos < buf.size(); ) {
+		size_t len;
+		char* p = parser.prepare(len);
+		len = std::min(len, buf.size() - pos);
+		memcpy(p, buf.data() + pos, len);
+		parser.commit(len);
+		pos += len;
+
+		ReceivedFrame f;
+		while (parser.next(f)) {
+			CHECK(i < 3 && string{f.text} == texts[i]);
+			if (version >= FRAME_VERSION_2) {
+				CHECK(f.seq == TEST_SEQ);
+				CHECK(f.meta.timestamp_us == TEST_TIMESTAMP);
+				CHECK(f.meta.text_number == TEST_TEXT_NUMBER);
+				CHECK(f.meta.process_id == TEST_PROCESS_ID);
+			} else {
+				// Counted per connection, no metadata
+				CHECK(f.seq == i + 1);
+				CHECK(f.meta.timestamp_us == 0);
+				CHECK(f.meta.text_number == 0);
+			}
+			++i;
+		}
+	}
+	CHECK(i == 3);
+	CHECK(!parser.failed());
+}
+
+static void test_meta_and_hello()
+{
+	string buf;
+	append_meta(buf, test_meta());
+	CHECK(buf.size() == SENTENCE_META_LEN);
+	CHECK(buf.substr(0, 8) == bytes({0x11, 0x12, 0x13, 0x14,
+		0x15, 0x16, 0x17, 0x18}));
+	SentenceMeta meta = get_meta(buf.data());
+	CHECK(meta.timestamp_us == TEST_TIMESTAMP);
+	CHECK(meta.text_number == TEST_TEXT_NUMBER);
+	CHECK(meta.process_id == TEST_PROCESS_ID);
+
+	string hello;
+	append_hello(hello, FRAME_VERSION_2, HELLO_FLAG_ACK | HELLO_FLAG_ZSTD);
+	CHECK(hello == string{"TCPS"} + bytes({2, 3, 0, 0}));
+
+	uint8_t version = 0, flags = 0;
+	CHECK(parse_hello(hello.data(), version, flags));
+	CHECK(version == FRAME_VERSION_2);
+	CHECK(flags == (HELLO_FLAG_ACK | HELLO_FLAG_ZSTD));
+
+	hello[0] = 'X';
+	CHECK(!parse_hello(hello.data(), version, flags));
+}
+
+int main()
+{
+	test_layout();
+	test_round_trip(FRAME_VERSION_LEGACY);
+	test_round_trip(FRAME_VERSION_2);
+	test_meta_and_hello();
+	return check_result();
+}
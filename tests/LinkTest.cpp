@@ -0,0 +1,152 @@
+/*
+ * Checks that a batch still being collected when the user disconnects is
+ * sent on the next connection, encoded in the frame version that one
+ * agreed on.
+ */
+
+#include "Check.h"
+#include "Config.h"
+#include "Frame.h"
+#include "Sender.h"
+#include "Session.h"
+#include "Socket.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using clk = std::chrono::steady_clock;
+using std::string;
+
+#define TEST_WAIT_MS 5000
+#define TEST_TEXT_NUMBER 7
+
+/**
+ * Listening socket on an ephemeral loopback port
+ */
+static SOCKET listen_loopback(uint16_t& port)
+{
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+		return sock;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+
+	if (bind(sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| getsockname(sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+			|| listen(sock, 1) == SOCKET_ERROR) {
+		close_socket(sock);
+		return INVALID_SOCKET;
+	}
+
+	port = ntohs(addr.sin_port);
+	return sock;
+}
+
+template <typename Cond>
+static bool wait_for(Cond cond)
+{
+	auto limit = clk::now() + std::chrono::milliseconds{TEST_WAIT_MS};
+	while (!cond()) {
+		if (clk::now() > limit)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	return true;
+}
+
+/**
+ * Accept one connection and receive from it until it closes or count
+ * frames arrived
+ */
+static std::vector<ReceivedFrame> receive(SOCKET listener, size_t count,
+	std::vector<string>& texts, int& version)
+{
+	std::vector<ReceivedFrame> frames;
+	SOCKET sock = accept(listener, NULL, NULL);
+	CHECK(sock != INVALID_SOCKET);
+	if (sock == INVALID_SOCKET)
+		return frames;
+
+	Session session{sock, 0};
+	while (frames.size() < count && session.poll([&](ReceivedFrame const& f) {
+				frames.push_back(f);
+				texts.emplace_back(f.text);
+			}))
+		;
+	version = session.version();
+	close_socket(sock);
+	return frames;
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	uint16_t port = 0;
+	SOCKET listener = listen_loopback(port);
+	CHECK(listener != INVALID_SOCKET);
+
+	// A long batch latency keeps the sentence in the batch being collected
+	Config cfg;
+	cfg.log_level = LogLevel::ERR;
+	cfg.remote = L"127.0.0.1:" + std::to_wstring(port);
+	cfg.connect = true;
+	cfg.batch_latency_ms = TEST_WAIT_MS * 4;
+
+	Sender sender{[] {}};
+	std::thread io{[&] { sender.run(); }};
+	sender.configure(cfg, std::filesystem::current_path());
+	CHECK(wait_for([&] {
+		return sender.status(0).state == ConnState::CONNECTED;
+	}));
+
+	sender.submit(L"collected", true, NULL, TEST_TEXT_NUMBER, 0);
+	CHECK(wait_for([&] { return sender.queue_depth(0) == 0; }));
+
+	// Disconnect while collecting, nothing has been sent
+	cfg.connect = false;
+	sender.configure(cfg, std::filesystem::current_path());
+
+	std::vector<string> texts;
+	int version = 0;
+	CHECK(receive(listener, 1, texts, version).empty());
+
+	// Reconnect with version 2, the batch is sent right away
+	cfg.connect = true;
+	cfg.frame_version = FRAME_VERSION_2;
+	cfg.batch_latency_ms = 0;
+	sender.configure(cfg, std::filesystem::current_path());
+
+	std::vector<ReceivedFrame> frames = receive(listener, 1, texts, version);
+	CHECK(version == FRAME_VERSION_2);
+	CHECK(frames.size() == 1);
+	CHECK(texts.size() == 1);
+	if (frames.size() == 1 && texts.size() == 1) {
+		CHECK(texts[0] == "collected");
+		CHECK(frames[0].seq == 1);
+		CHECK(frames[0].meta.text_number == TEST_TEXT_NUMBER);
+		CHECK(frames[0].meta.timestamp_us != 0);
+	}
+
+	sender.stop();
+	io.join();
+	close_socket(listener);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return check_result();
+}
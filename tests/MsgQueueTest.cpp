@@ -0,0 +1,156 @@
+/*
+ * Unit and stress tests of the lock-free sentence queue
+ */
+
+#include "Check.h"
+#include "LaneQueue.h"
+#include "MsgQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#define STRESS_PRODUCERS 4
+#define STRESS_PER_PRODUCER 200000
+#define STRESS_CAPACITY 64
+
+static void push_value(MsgQueue<uint64_t>& q, uint64_t v, DropPolicy policy)
+{
+	q.push([&](uint64_t& slot) { slot = v; }, policy);
+}
+
+static void test_fifo()
+{
+	MsgQueue<uint64_t> q{5};
+	CHECK(q.capacity() == 8);
+	CHECK(q.empty());
+
+	for (uint64_t i = 0; i < 8; ++i)
+		push_value(q, i, DropPolicy::NEWEST);
+	CHECK(q.size() == 8);
+	CHECK(q.dropped() == 0);
+
+	uint64_t v = 0;
+	for (uint64_t i = 0; i < 8; ++i) {
+		CHECK(q.pop(v));
+		CHECK(v == i);
+	}
+	CHECK(!q.pop(v));
+	CHECK(q.empty());
+}
+
+static void test_drop_policy()
+{
+	MsgQueue<uint64_t> oldest{4};
+	for (uint64_t i = 0; i < 6; ++i)
+		push_value(oldest, i, DropPolicy::OLDEST);
+	CHECK(oldest.dropped() == 2);
+
+	uint64_t v = 0;
+	CHECK(oldest.pop(v) && v == 2);
+
+	MsgQueue<uint64_t> newest{4};
+	for (uint64_t i = 0; i < 6; ++i)
+		push_value(newest, i, DropPolicy::NEWEST);
+	CHECK(newest.dropped() == 2);
+	CHECK(newest.pop(v) && v == 0);
+}
+
+static void test_limit()
+{
+	MsgQueue<uint64_t> q{16};
+	q.set_limit(3);
+	for (uint64_t i = 0; i < 5; ++i)
+		push_value(q, i, DropPolicy::OLDEST);
+	CHECK(q.size() == 3);
+	CHECK(q.dropped() == 2);
+
+	uint64_t v = 0;
+	CHECK(q.pop(v) && v == 2);
+
+	// Shrinking evicts on the next push, growing is capped at capacity
+	q.set_limit(1);
+	push_value(q, 5, DropPolicy::OLDEST);
+	CHECK(q.size() == 1);
+	CHECK(q.pop(v) && v == 5);
+
+	q.set_limit(1000);
+	for (uint64_t i = 0; i < 20; ++i)
+		push_value(q, i, DropPolicy::NEWEST);
+	CHECK(q.size() == 16);
+}
+
+static void test_lanes()
+{
+	LaneQueue<uint64_t> q{3, 4};
+
+	// A busy lane only evicts its own elements
+	for (uint64_t i = 0; i < 10; ++i)
+		q.push(1, [&](uint64_t& slot) { slot = 100 + i; }, DropPolicy::OLDEST);
+	q.push(0, [](uint64_t& slot) { slot = 1; }, DropPolicy::OLDEST);
+	q.push(2, [](uint64_t& slot) { slot = 2; }, DropPolicy::OLDEST);
+	CHECK(q.size() == 6);
+	CHECK(q.dropped() == 6);
+
+	// Drained in turn
+	uint64_t v = 0;
+	CHECK(q.pop(v) && v == 1);
+	CHECK(q.pop(v) && v == 106);
+	CHECK(q.pop(v) && v == 2);
+	CHECK(q.pop(v) && v == 107);
+}
+
+/**
+ * Producers push numbered values while one consumer pops. Nothing may be
+ * lost or duplicated and each producer's values arrive in order.
+ */
+static void test_stress(DropPolicy policy)
+{
+	MsgQueue<uint64_t> q{STRESS_CAPACITY};
+	std::atomic<unsigned> running{STRESS_PRODUCERS};
+	std::vector<std::thread> producers;
+
+	for (uint64_t p = 0; p < STRESS_PRODUCERS; ++p) {
+		producers.emplace_back([&, p] {
+			for (uint64_t i = 1; i <= STRESS_PER_PRODUCER; ++i)
+				push_value(q, p << 32 | i, policy);
+			--running;
+		});
+	}
+
+	uint64_t last[STRESS_PRODUCERS] = {};
+	uint64_t popped = 0;
+	bool ordered = true;
+	uint64_t v = 0;
+
+	while (running > 0 || !q.empty()) {
+		if (!q.pop(v))
+			continue;
+
+		uint64_t p = v >> 32, i = v & 0xffffffff;
+		if (p >= STRESS_PRODUCERS || i <= last[p])
+			ordered = false;
+		else
+			last[p] = i;
+		++popped;
+	}
+
+	for (std::thread& t : producers)
+		t.join();
+
+	CHECK(ordered);
+	CHECK(popped + q.dropped() == STRESS_PRODUCERS * STRESS_PER_PRODUCER);
+	CHECK(q.empty());
+}
+
+int main()
+{
+	test_fifo();
+	test_drop_policy();
+	test_limit();
+	test_lanes();
+	test_stress(DropPolicy::OLDEST);
+	test_stress(DropPolicy::NEWEST);
+	return check_result();
+}
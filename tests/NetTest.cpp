@@ -0,0 +1,249 @@
+/*
+ * Loopback tests of connecting and resolving: Happy Eyeballs falling back
+ * to the next address, and the DNS cache looking up on its worker, waking
+ * the reactor and expiring answers and failures after their TTL.
+ */
+
+#include "Check.h"
+#include "Net.h"
+#include "Reactor.h"
+#include "Socket.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using clk = std::chrono::steady_clock;
+
+#define TEST_TTL_MS 50
+#define TEST_WAIT_MS 5000
+
+/**
+ * Listening socket on an ephemeral loopback port
+ */
+static SOCKET listen_loopback(uint16_t& port)
+{
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+		return sock;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+
+	if (bind(sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| getsockname(sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+			|| listen(sock, 4) == SOCKET_ERROR) {
+		close_socket(sock);
+		return INVALID_SOCKET;
+	}
+
+	port = ntohs(addr.sin_port);
+	return sock;
+}
+
+/**
+ * A loopback port nothing listens on, connecting to it is refused
+ */
+static uint16_t closed_port()
+{
+	uint16_t port = 0;
+	SOCKET sock = listen_loopback(port);
+	close_socket(sock);
+	return port;
+}
+
+/**
+ * Resolve numeric addresses synchronously, for building address lists
+ */
+static addrinfo* numeric(char const* host, uint16_t port, int family)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+	addrinfo* res = NULL;
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &res) != 0)
+		return NULL;
+	return res;
+}
+
+/**
+ * Step the connector until it connects or gives up
+ */
+static SOCKET connect_all(Reactor& reactor, Connector& connector)
+{
+	auto limit = clk::now() + std::chrono::milliseconds{TEST_WAIT_MS};
+	while (clk::now() < limit) {
+		auto now = clk::now();
+		auto deadline = limit;
+		SOCKET sock = connector.step(reactor, now, deadline);
+		if (sock != INVALID_SOCKET || connector.failed())
+			return sock;
+		reactor.prepare_sleep();
+		reactor.wait(deadline);
+	}
+	return INVALID_SOCKET;
+}
+
+/**
+ * Call resolve until it answers, sleeping in the reactor in between like
+ * the I/O loop does
+ */
+static DnsStatus resolve_wait(Reactor& reactor, DnsCache& cache,
+	std::wstring const& remote, unsigned ttl_ms)
+{
+	auto limit = clk::now() + std::chrono::milliseconds{TEST_WAIT_MS};
+	DnsStatus status;
+	while ((status = cache.resolve(remote, ttl_ms, reactor))
+			== DnsStatus::PENDING && clk::now() < limit) {
+		reactor.prepare_sleep();
+		if (!cache.done())
+			reactor.wait(limit);
+	}
+	return status;
+}
+
+static void test_fallback(Reactor& reactor)
+{
+	uint16_t port = 0;
+	SOCKET listener = listen_loopback(port);
+	CHECK(listener != INVALID_SOCKET);
+
+	// The preferred IPv6 address refuses, or fails right away without
+	// IPv6, the IPv4 one behind it accepts
+	uint16_t refused = closed_port();
+	addrinfo* list = numeric("::1", refused, AF_INET6);
+	addrinfo* good = numeric("127.0.0.1", port, AF_INET);
+	CHECK(good != NULL);
+	if (list == NULL) {
+		list = numeric("127.0.0.1", refused, AF_INET);
+		list->ai_next = good;
+	} else {
+		list->ai_next = numeric("127.0.0.1", refused, AF_INET);
+		list->ai_next->ai_next = good;
+	}
+
+	// A long stagger only passes if failures start the next attempt
+	Connector connector;
+	auto start = clk::now();
+	connector.start(list, TEST_WAIT_MS, TEST_WAIT_MS);
+	SOCKET sock = connect_all(reactor, connector);
+	CHECK(sock != INVALID_SOCKET);
+	CHECK(clk::now() - start < std::chrono::milliseconds{TEST_WAIT_MS / 2});
+
+	if (sock != INVALID_SOCKET) {
+		sockaddr_in local;
+		socklen_t len = sizeof(local);
+		CHECK(getsockname(sock, (sockaddr*) &local, &len) == 0);
+		CHECK(local.sin_family == AF_INET);
+
+		SOCKET accepted = accept(listener, NULL, NULL);
+		CHECK(accepted != INVALID_SOCKET);
+		close_socket(accepted);
+		close_socket(sock);
+	}
+
+	// Nothing left to fall back on
+	addrinfo* dead = numeric("127.0.0.1", refused, AF_INET);
+	connector.start(dead, TEST_WAIT_MS, TEST_WAIT_MS);
+	CHECK(connect_all(reactor, connector) == INVALID_SOCKET);
+	CHECK(connector.failed());
+
+	freeaddrinfo(dead);
+	while (list != NULL) {
+		addrinfo* next = list->ai_next;
+		list->ai_next = NULL;
+		freeaddrinfo(list);
+		list = next;
+	}
+	close_socket(listener);
+}
+
+static void test_ttl(Reactor& reactor)
+{
+	DnsCache cache;
+	std::wstring remote = L"127.0.0.1:30501";
+
+	// The first lookup runs on the worker and wakes the reactor
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::PENDING);
+	auto start = clk::now();
+	CHECK(resolve_wait(reactor, cache, remote, TEST_TTL_MS)
+		== DnsStatus::RESOLVED);
+	CHECK(clk::now() - start < std::chrono::milliseconds{TEST_WAIT_MS / 2});
+	CHECK(cache.addresses() != NULL);
+	CHECK(cache.misses() == 1);
+
+	// Answered from the cache until the TTL expires
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::RESOLVED);
+	CHECK(cache.hits() == 1);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds{TEST_TTL_MS * 2});
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::PENDING);
+	CHECK(cache.misses() == 2);
+	CHECK(resolve_wait(reactor, cache, remote, TEST_TTL_MS)
+		== DnsStatus::RESOLVED);
+
+	// invalidate() forces a new lookup
+	cache.invalidate();
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::PENDING);
+	CHECK(cache.misses() == 3);
+	CHECK(resolve_wait(reactor, cache, remote, TEST_TTL_MS)
+		== DnsStatus::RESOLVED);
+
+	// A TTL of 0 looks up every time but still answers
+	std::wstring other = L"127.0.0.1:30502";
+	CHECK(resolve_wait(reactor, cache, other, 0) == DnsStatus::RESOLVED);
+	CHECK(cache.resolve(other, 0, reactor) == DnsStatus::PENDING);
+	CHECK(resolve_wait(reactor, cache, other, 0) == DnsStatus::RESOLVED);
+}
+
+static void test_negative(Reactor& reactor)
+{
+	DnsCache cache;
+
+	// Fails without asking a name server
+	std::wstring remote = L"127.0.0.1:no-such-service";
+
+	CHECK(resolve_wait(reactor, cache, remote, TEST_TTL_MS)
+		== DnsStatus::FAILED);
+	CHECK(cache.misses() == 1);
+
+	// Failures are cached too, for at most the TTL
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::FAILED);
+	CHECK(cache.hits() == 1);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds{TEST_TTL_MS * 2});
+	CHECK(cache.resolve(remote, TEST_TTL_MS, reactor) == DnsStatus::PENDING);
+	CHECK(resolve_wait(reactor, cache, remote, TEST_TTL_MS)
+		== DnsStatus::FAILED);
+	CHECK(cache.misses() == 2);
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	Reactor reactor;
+	CHECK(reactor.open());
+
+	test_fallback(reactor);
+	test_ttl(reactor);
+	test_negative(reactor);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return check_result();
+}
@@ -0,0 +1,322 @@
+/*
+ * Unit tests of the reference receiver: splitting the byte stream into
+ * frames however it arrives, rejecting corrupt streams, skipping header
+ * fields of later versions and answering the version 2 handshake.
+ */
+
+#include "AckWindow.h"
+#include "Check.h"
+#include "Compress.h"
+#include "Frame.h"
+#include "FrameParser.h"
+#include "Session.h"
+#include "Socket.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using std::string;
+
+#define EXTRA_HEADER_LEN 6
+
+static SentenceMeta test_meta(uint32_t i)
+{
+	SentenceMeta meta;
+	meta.timestamp_us = 1700000000000000ull + i;
+	meta.text_number = 10 + i;
+	meta.process_id = 4242;
+	return meta;
+}
+
+static void append_frame(string& buf, int version, uint64_t seq,
+	string const& text)
+{
+	size_t off = begin_frame(buf, version);
+	buf += text;
+	end_frame(buf, off, version, seq, test_meta((uint32_t) seq));
+}
+
+/**
+ * Copy data into the parser in pieces of at most step bytes and collect
+ * the texts of all frames completed along the way
+ */
+static std::vector<string> feed(FrameParser& parser, string const& data,
+	size_t step)
+{
+	std::vector<string> texts;
+	for (size_t pos = 0; pos < data.size(); ) {
+		size_t len;
+		char* p = parser.prepare(len);
+		size_t n = std::min({len, step, data.size() - pos});
+		memcpy(p, data.data() + pos, n);
+		parser.commit(n);
+		pos += n;
+
+		parser.parse([&](ReceivedFrame const& f) {
+			texts.emplace_back(f.text);
+		});
+	}
+	return texts;
+}
+
+static void test_split(int version)
+{
+	// A small buffer also makes the parser grow
+	FrameParser parser{version, 16};
+	string data;
+	append_frame(data, version, 1, u8"「それじゃあ、また明日」");
+	append_frame(data, version, 2, "");
+	append_frame(data, version, 3, string(100, 'x'));
+
+	std::vector<string> texts = feed(parser, data, 1);
+	CHECK(texts.size() == 3);
+	if (texts.size() == 3) {
+		CHECK(texts[0] == u8"「それじゃあ、また明日」");
+		CHECK(texts[1].empty());
+		CHECK(texts[2] == string(100, 'x'));
+	}
+	CHECK(!parser.failed());
+	CHECK(parser.last_seq() == 3);
+	CHECK(parser.available() == 0);
+}
+
+static void test_one_read()
+{
+	FrameParser parser{FRAME_VERSION_2};
+	string data;
+	for (uint64_t seq = 5; seq < 9; ++seq)
+		append_frame(data, FRAME_VERSION_2, seq, "line " + std::to_string(seq));
+
+	// Half a frame stays buffered for the next read
+	string partial;
+	append_frame(partial, FRAME_VERSION_2, 9, "line 9");
+	data += partial.substr(0, partial.size() / 2);
+
+	size_t len;
+	char* p = parser.prepare(len);
+	CHECK(len >= data.size());
+	memcpy(p, data.data(), data.size());
+	parser.commit(data.size());
+
+	std::vector<ReceivedFrame> frames;
+	std::vector<string> texts;
+	CHECK(parser.parse([&](ReceivedFrame const& f) {
+		frames.push_back(f);
+		texts.emplace_back(f.text);
+	}) == 4);
+	CHECK(!parser.failed());
+	for (size_t i = 0; i < frames.size(); ++i) {
+		CHECK(frames[i].seq == 5 + i);
+		CHECK(texts[i] == "line " + std::to_string(5 + i));
+		CHECK(frames[i].meta.timestamp_us == test_meta(5 + i).timestamp_us);
+		CHECK(frames[i].meta.text_number == test_meta(5 + i).text_number);
+		CHECK(frames[i].meta.process_id == 4242);
+	}
+	CHECK(parser.available() == partial.size() / 2);
+}
+
+static void test_too_long()
+{
+	for (int version : {FRAME_VERSION_LEGACY, FRAME_VERSION_2}) {
+		FrameParser parser{version};
+		char header[4];
+		put_le32(header, FRAME_PARSER_MAX_FRAME + 1);
+
+		std::vector<string> texts = feed(parser, string(header, 4), 4);
+		CHECK(texts.empty());
+		CHECK(parser.failed());
+
+		// Stays failed
+		ReceivedFrame frame;
+		CHECK(!parser.next(frame));
+		CHECK(parser.failed());
+	}
+
+	// Version 2 headers shorter than the known fields are corrupt too
+	FrameParser parser{FRAME_VERSION_2};
+	string data;
+	append_frame(data, FRAME_VERSION_2, 1, "text");
+	put_le16(&data[6], FRAME_V2_HEADER_LEN - 1);
+	CHECK(feed(parser, data, data.size()).empty());
+	CHECK(parser.failed());
+}
+
+static void test_longer_header()
+{
+	// A later version appends fields to the header
+	string data;
+	append_frame(data, FRAME_VERSION_2, 7, "first");
+	data.insert(4 + FRAME_V2_HEADER_LEN, EXTRA_HEADER_LEN, '\x7f');
+	put_le32(&data[0], (uint32_t) (data.size() - 4));
+	put_le16(&data[6], FRAME_V2_HEADER_LEN + EXTRA_HEADER_LEN);
+
+	// Also with nothing but the header
+	string empty;
+	append_frame(empty, FRAME_VERSION_2, 8, "");
+	empty.append(EXTRA_HEADER_LEN, '\x7f');
+	put_le32(&empty[0], (uint32_t) (empty.size() - 4));
+	put_le16(&empty[6], FRAME_V2_HEADER_LEN + EXTRA_HEADER_LEN);
+	data += empty;
+
+	append_frame(data, FRAME_VERSION_2, 9, "last");
+
+	FrameParser parser{FRAME_VERSION_2};
+	std::vector<ReceivedFrame> frames;
+	std::vector<string> texts;
+	size_t len;
+	char* p = parser.prepare(len);
+	memcpy(p, data.data(), data.size());
+	parser.commit(data.size());
+	parser.parse([&](ReceivedFrame const& f) {
+		frames.push_back(f);
+		texts.emplace_back(f.text);
+	});
+
+	CHECK(!parser.failed());
+	CHECK(frames.size() == 3);
+	if (frames.size() == 3) {
+		CHECK(frames[0].seq == 7);
+		CHECK(texts[0] == "first");
+		CHECK(frames[0].meta.text_number == test_meta(7).text_number);
+		CHECK(frames[0].meta.process_id == 4242);
+		CHECK(frames[1].seq == 8);
+		CHECK(texts[1].empty());
+		CHECK(frames[2].seq == 9);
+		CHECK(texts[2] == "last");
+	}
+}
+
+/**
+ * Blocking loopback connection, out is the sender's end
+ */
+static bool connect_pair(SOCKET& out, SOCKET& in)
+{
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	out = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	in = INVALID_SOCKET;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+
+	if (listener != INVALID_SOCKET && out != INVALID_SOCKET
+			&& bind(listener, (sockaddr*) &addr, sizeof(addr)) != SOCKET_ERROR
+			&& getsockname(listener, (sockaddr*) &addr, &len) != SOCKET_ERROR
+			&& listen(listener, 1) != SOCKET_ERROR
+			&& connect(out, (sockaddr*) &addr, sizeof(addr)) != SOCKET_ERROR)
+		in = accept(listener, NULL, NULL);
+
+	if (listener != INVALID_SOCKET)
+		close_socket(listener);
+	return in != INVALID_SOCKET;
+}
+
+static bool send_str(SOCKET sock, string const& data)
+{
+	return send(sock, data.data(), (int) data.size(), 0) == (int) data.size();
+}
+
+static bool recv_all(SOCKET sock, char* buf, size_t len)
+{
+	while (len > 0) {
+		int got = recv(sock, buf, (int) len, 0);
+		if (got <= 0)
+			return false;
+		buf += got;
+		len -= got;
+	}
+	return true;
+}
+
+/**
+ * Handshake offering offer_flags to a session accepting accept_flags,
+ * then one frame, compressed if agreed on.
+ * Returns the flags of the reply.
+ */
+static uint8_t handshake(uint8_t offer_flags, uint8_t accept_flags)
+{
+	SOCKET out, in;
+	if (!connect_pair(out, in)) {
+		fprintf(stderr, "Could not connect on loopback\n");
+		++check_failures;
+		return 0xff;
+	}
+
+	Session session{in, accept_flags};
+	string hello;
+	append_hello(hello, FRAME_VERSION_2, offer_flags);
+	CHECK(send_str(out, hello));
+	CHECK(session.poll([](ReceivedFrame const&) {}));
+
+	char reply[HELLO_LEN];
+	uint8_t version = 0, flags = 0xff;
+	CHECK(recv_all(out, reply, HELLO_LEN));
+	CHECK(parse_hello(reply, version, flags));
+	CHECK(version == FRAME_VERSION_2);
+	CHECK(session.version() == FRAME_VERSION_2);
+	CHECK(session.flags() == flags);
+
+	string frame;
+	append_frame(frame, FRAME_VERSION_2, 1, u8"こんにちは");
+	string wire = frame;
+	StreamCompressor zs;
+	if (flags & HELLO_FLAG_ZSTD) {
+		CHECK(zs.start(3));
+		CHECK(zs.compress(frame.data(), frame.size(), wire));
+	}
+	CHECK(send_str(out, wire));
+
+	string text;
+	CHECK(session.poll([&](ReceivedFrame const& f) { text = string{f.text}; }));
+	CHECK(text == u8"こんにちは");
+	CHECK(session.bytes_received() == HELLO_LEN + wire.size());
+	CHECK(session.bytes_decoded() == HELLO_LEN + frame.size());
+
+	if (flags & HELLO_FLAG_ACK) {
+		char ack[ACK_LEN];
+		CHECK(recv_all(out, ack, ACK_LEN));
+		CHECK(get_le64(ack) == 1);
+	}
+
+	close_socket(out);
+	close_socket(in);
+	return flags;
+}
+
+static void test_handshake()
+{
+	uint8_t both = HELLO_FLAG_ACK | HELLO_FLAG_ZSTD;
+
+	// Compression only if offered, accepted and built in
+	CHECK(handshake(both, both) == (Session::decompression_available()
+		? both : HELLO_FLAG_ACK));
+	CHECK(handshake(both, HELLO_FLAG_ACK) == HELLO_FLAG_ACK);
+	CHECK(handshake(HELLO_FLAG_ACK, both) == HELLO_FLAG_ACK);
+	CHECK(handshake(0, both) == 0);
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	test_split(FRAME_VERSION_LEGACY);
+	test_split(FRAME_VERSION_2);
+	test_one_read();
+	test_too_long();
+	test_longer_header();
+	test_handshake();
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return check_result();
+}
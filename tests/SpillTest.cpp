@@ -0,0 +1,142 @@
+/*
+ * Checks that sentences queued while a receiver is not connected yet go to
+ * the spill log instead of overflowing the queue, and arrive in order once
+ * the receiver answers.
+ */
+
+#include "Check.h"
+#include "Config.h"
+#include "Frame.h"
+#include "Sender.h"
+#include "Session.h"
+#include "Socket.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using clk = std::chrono::steady_clock;
+using std::string;
+
+#define TEST_ROUNDS 20
+#define TEST_WAIT_MS 5000
+#define TEST_SPILL_FILE L"tcpsender_spill_test.bin"
+
+/**
+ * Listening socket on an ephemeral loopback port
+ */
+static SOCKET listen_loopback(uint16_t& port)
+{
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+		return sock;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+
+	if (bind(sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+			|| getsockname(sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+			|| listen(sock, 1) == SOCKET_ERROR) {
+		close_socket(sock);
+		return INVALID_SOCKET;
+	}
+
+	port = ntohs(addr.sin_port);
+	return sock;
+}
+
+/**
+ * Wait until the I/O loop took everything off the queue
+ */
+static bool wait_drained(Sender& sender)
+{
+	auto limit = clk::now() + std::chrono::milliseconds{TEST_WAIT_MS};
+	while (sender.queue_depth(0) > 0) {
+		if (clk::now() > limit)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	return true;
+}
+
+static string sentence(size_t i)
+{
+	return "Sentence " + std::to_string(i);
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	uint16_t port = 0;
+	SOCKET listener = listen_loopback(port);
+	CHECK(listener != INVALID_SOCKET);
+
+	auto dir = std::filesystem::temp_directory_path();
+	std::filesystem::remove(dir / TEST_SPILL_FILE);
+
+	// The connection is made by the backlog but nobody accepts it, so the
+	// hello stays unanswered and the link in its handshake
+	Config cfg;
+	cfg.log_level = LogLevel::ERR;
+	cfg.remote = L"127.0.0.1:" + std::to_wstring(port);
+	cfg.connect = true;
+	cfg.frame_version = FRAME_VERSION_2;
+	cfg.connect_timeout_ms = TEST_WAIT_MS * 2;
+	cfg.spill_file = TEST_SPILL_FILE;
+
+	Sender sender{[] {}};
+	std::thread io{[&] { sender.run(); }};
+	sender.configure(cfg, dir);
+
+	// Fill the queue to its limit over and over, the I/O loop has to make
+	// room each time
+	size_t n = 0;
+	for (int round = 0; round < TEST_ROUNDS; ++round) {
+		for (unsigned i = 0; i < cfg.queue_capacity; ++i, ++n)
+			sender.submit(to_utf16(sentence(n)).c_str(), true, NULL, 1, 0);
+		CHECK(wait_drained(sender));
+	}
+	CHECK(sender.status(0).state == ConnState::CONNECTING);
+	CHECK(sender.dropped() == 0);
+
+	// Answer the handshake and collect what was spilled
+	std::vector<string> received;
+	SOCKET sock = accept(listener, NULL, NULL);
+	CHECK(sock != INVALID_SOCKET);
+	if (sock != INVALID_SOCKET) {
+		Session session{sock, 0};
+		auto limit = clk::now() + std::chrono::milliseconds{TEST_WAIT_MS};
+		while (received.size() < n && clk::now() < limit
+				&& session.poll([&](ReceivedFrame const& f) {
+					received.emplace_back(f.text);
+				}))
+			;
+		close_socket(sock);
+	}
+
+	CHECK(received.size() == n);
+	for (size_t i = 0; i < received.size() && i < n; ++i)
+		CHECK(received[i] == sentence(i));
+
+	sender.stop();
+	io.join();
+	close_socket(listener);
+	std::filesystem::remove(dir / TEST_SPILL_FILE);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	return check_result();
+}
@@ -0,0 +1,219 @@
+/*
+ * Checks that Sender::submit does not allocate once warmed up, with the
+ * sentence encoded straight into pooled buffers and queued in place. Only
+ * allocations on the submitting thread count, the I/O thread and the
+ * receiver may allocate as they like.
+ */
+
+#include "Check.h"
+#include "Config.h"
+#include "Frame.h"
+#include "Sender.h"
+#include "Session.h"
+#include "Socket.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <thread>
+
+using std::wstring;
+
+#define WARMUP_SUBMITS 2000
+#define MEASURED_SUBMITS 20000
+#define CONNECT_WAIT_MS 5000
+
+static thread_local uint64_t n_allocs = 0;
+
+void* operator new(size_t n)
+{
+	++n_allocs;
+	if (void* p = std::malloc(n ? n : 1))
+		return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+static wchar_t const* const SENTENCES[] = {
+	L"「それじゃあ、また明日」",
+	L"Chapter 3: The Lighthouse",
+	L"彼女は何も言わずに窓の外を見つめていた。",
+	L"【アリス】",
+	L"ここここ",
+	L"\U0001F600 surrogates \U00020BB7",
+};
+#define N_SENTENCES (sizeof(SENTENCES) / sizeof(SENTENCES[0]))
+
+/**
+ * Allocations per submit on this thread after warming up
+ */
+static double allocs_per_submit(Sender& sender)
+{
+	auto submit = [&](size_t i) {
+		bool selected = i % 3 != 0;
+		sender.submit(SENTENCES[i % N_SENTENCES], selected,
+			selected ? NULL : L"Other", (uint32_t) (i % 7), 1);
+	};
+
+	for (size_t i = 0; i < WARMUP_SUBMITS; ++i)
+		submit(i);
+
+	uint64_t before = n_allocs;
+	for (size_t i = WARMUP_SUBMITS; i < WARMUP_SUBMITS + MEASURED_SUBMITS; ++i)
+		submit(i);
+	return (double) (n_allocs - before) / MEASURED_SUBMITS;
+}
+
+/**
+ * Loopback listener draining whatever arrives
+ */
+struct Drain {
+	SOCKET listen_sock = INVALID_SOCKET;
+	uint16_t port = 0;
+	std::thread thread;
+
+	bool start()
+	{
+		listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_sock == INVALID_SOCKET)
+			return false;
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+
+		if (bind(listen_sock, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR
+				|| getsockname(listen_sock, (sockaddr*) &addr, &len) == SOCKET_ERROR
+				|| listen(listen_sock, 1) == SOCKET_ERROR)
+			return false;
+		port = ntohs(addr.sin_port);
+
+		thread = std::thread{[this] {
+			SOCKET sock = accept(listen_sock, NULL, NULL);
+			if (sock == INVALID_SOCKET)
+				return;
+			Session session{sock, HELLO_FLAG_ACK};
+			while (session.poll([](ReceivedFrame const&) {}))
+				;
+			close_socket(sock);
+		}};
+		return true;
+	}
+
+	void stop()
+	{
+		if (thread.joinable())
+			thread.join();
+		if (listen_sock != INVALID_SOCKET)
+			close_socket(listen_sock);
+	}
+};
+
+static bool wait_connected(Sender& sender)
+{
+	auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds{CONNECT_WAIT_MS};
+	while (sender.status(0).state != ConnState::CONNECTED) {
+		if (std::chrono::steady_clock::now() > deadline)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	return true;
+}
+
+/**
+ * Nobody takes sentences off the queues, so every submit evicts one
+ */
+static void test_overflowing(Config cfg)
+{
+	cfg.remote = L"127.0.0.1:9,127.0.0.1:9";
+	cfg.connect = false;
+
+	Sender sender{[] {}};
+	std::thread io{[&] { sender.run(); }};
+	sender.configure(cfg, std::filesystem::current_path());
+
+	double n = allocs_per_submit(sender);
+	fprintf(stderr, "overflowing: %.4f allocations per submit\n", n);
+	CHECK(n == 0);
+	CHECK(sender.dropped() > 0);
+
+	sender.stop();
+	io.join();
+}
+
+/**
+ * Sentences flow to a receiver on loopback
+ */
+static void test_sending(Config cfg)
+{
+	Drain drain;
+	if (!drain.start()) {
+		fprintf(stderr, "Could not listen on loopback\n");
+		++check_failures;
+		return;
+	}
+
+	cfg.remote = L"127.0.0.1:" + std::to_wstring(drain.port);
+	cfg.connect = true;
+
+	Sender sender{[] {}};
+	std::thread io{[&] { sender.run(); }};
+	sender.configure(cfg, std::filesystem::current_path());
+
+	CHECK(wait_connected(sender));
+	double n = allocs_per_submit(sender);
+	fprintf(stderr, "sending: %.4f allocations per submit\n", n);
+	CHECK(n == 0);
+
+	sender.stop();
+	io.join();
+	drain.stop();
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return 1;
+#endif
+
+	Config plain;
+	plain.log_level = LogLevel::ERR;
+
+	// Every optional stage of submit
+	Config full = plain;
+	full.frame_version = FRAME_VERSION_2;
+	full.forward_all_threads = true;
+	full.thread_deny = L"Console";
+	full.dedup_recent = 4;
+	full.collapse_repeats = COLLAPSE_CHARS | COLLAPSE_TEXT;
+	full.latency_trace = true;
+
+	test_overflowing(plain);
+	test_overflowing(full);
+	test_sending(plain);
+	test_sending(full);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return check_result();
+}
@@ -0,0 +1,146 @@
+/*
+ * Unit tests of the UTF-16/UTF-8 transcoder. Built once per vector path
+ * (AVX2, SSE2, scalar) where the compiler allows, the char16_t overloads
+ * run the 16 bit paths even where wchar_t is 32 bit.
+ */
+
+#include "Check.h"
+#include "Utf.h"
+
+#include <string>
+
+using std::string;
+using std::u16string;
+using std::wstring;
+
+// Exit code meson counts as a skipped test
+#define TEST_SKIP 77
+
+static string encode(u16string const& s)
+{
+	string out(s.size() * 3, '\0');
+	out.resize(utf16_to_utf8(s.data(), s.size(), &out[0]));
+	return out;
+}
+
+static string encode(wstring const& s)
+{
+	return to_utf8(s);
+}
+
+static u16string decode16(string const& s)
+{
+	u16string out(s.size(), u'\0');
+	out.resize(utf8_to_utf16(s.data(), s.size(), &out[0]));
+	return out;
+}
+
+static void test_ascii()
+{
+	string ascii;
+	for (int i = 0; i < 300; ++i)
+		ascii += (char) (' ' + i % 95);
+
+	u16string a16(ascii.begin(), ascii.end());
+	wstring aw(ascii.begin(), ascii.end());
+
+	// Every length around the vector widths
+	for (size_t n = 0; n <= 70; ++n) {
+		CHECK(encode(a16.substr(0, n)) == ascii.substr(0, n));
+		CHECK(encode(aw.substr(0, n)) == ascii.substr(0, n));
+		CHECK(decode16(ascii.substr(0, n)) == a16.substr(0, n));
+		CHECK(to_utf16(ascii.substr(0, n)) == aw.substr(0, n));
+	}
+	CHECK(encode(a16) == ascii);
+	CHECK(decode16(ascii) == a16);
+}
+
+static void test_cjk()
+{
+	u16string const s16 = u"「それじゃあ、また明日」Chapter 3: The Lighthouse【アリス】";
+	wstring const sw = L"「それじゃあ、また明日」Chapter 3: The Lighthouse【アリス】";
+	string const s8 = u8"「それじゃあ、また明日」Chapter 3: The Lighthouse【アリス】";
+
+	CHECK(encode(s16) == s8);
+	CHECK(encode(sw) == s8);
+	CHECK(decode16(s8) == s16);
+	CHECK(to_utf16(s8) == sw);
+
+	// A wide character at every position of an ASCII run, so the vector
+	// loops stop and resume at every offset
+	for (size_t k = 0; k < 40; ++k) {
+		u16string t16(40, u'a');
+		t16[k] = u'あ';
+		string t8 = string(k, 'a') + u8"あ" + string(39 - k, 'a');
+
+		CHECK(encode(t16) == t8);
+		CHECK(decode16(t8) == t16);
+	}
+
+	// Two and three byte sequences back to back
+	CHECK(encode(u16string{u"é漢ßü"}) == u8"é漢ßü");
+	CHECK(decode16(u8"é漢ßü") == u"é漢ßü");
+}
+
+static void test_surrogates()
+{
+	// U+1F600 and U+20BB7, outside the BMP
+	string const emoji = "\xF0\x9F\x98\x80";
+	string const kanji = "\xF0\xA0\xAE\xB7";
+
+	CHECK(encode(u16string{u"\xD83D\xDE00"}) == emoji);
+	CHECK(encode(u16string{u"a\xD842\xDFB7z"}) == "a" + kanji + "z");
+	CHECK(decode16(emoji) == u"\xD83D\xDE00");
+	CHECK(decode16("a" + kanji + "z") == u"a\xD842\xDFB7z");
+	CHECK(to_utf8(to_utf16(emoji + kanji)) == emoji + kanji);
+
+	// Pair split behind a long ASCII run
+	u16string run(33, u'x');
+	CHECK(encode(run + u"\xD83D\xDE00") == string(33, 'x') + emoji);
+
+	// Lone and reversed surrogates become U+FFFD
+	string const fffd = "\xEF\xBF\xBD";
+	CHECK(encode(u16string{u'\xD800'}) == fffd);
+	CHECK(encode(u16string{u"a\xD800" u"b"}) == "a" + fffd + "b");
+	CHECK(encode(u16string{u"a\xDC00" u"b"}) == "a" + fffd + "b");
+	CHECK(encode(u16string{u"\xDE00\xD83D"}) == fffd + fffd);
+	CHECK(encode(u16string{u"\xD83D\xD83D\xDE00"}) == fffd + emoji);
+}
+
+static void test_invalid_utf8()
+{
+	u16string const fffd = u"\xFFFD";
+
+	// Overlong, truncated, stray continuation, encoded surrogate, beyond
+	// U+10FFFF and bytes that never appear in UTF-8
+	CHECK(decode16("\xC0\x80") == fffd + fffd);
+	CHECK(decode16("a\xE3\x81") == u"a" + fffd + fffd);
+	CHECK(decode16("\x80z") == fffd + u"z");
+	CHECK(decode16("\xED\xA0\x80") == fffd + fffd + fffd);
+	CHECK(decode16("\xF4\x90\x80\x80") == fffd + fffd + fffd + fffd);
+	CHECK(decode16("\xFF\xFE") == fffd + fffd);
+
+	// Invalid bytes in the middle of a long ASCII run
+	string s(20, 'a');
+	s += "\xE3\x81";
+	s += string(20, 'b');
+	CHECK(decode16(s) == u16string(20, u'a') + fffd + fffd
+		+ u16string(20, u'b'));
+
+	// Output never exceeds the documented bounds
+	CHECK(decode16(string(64, '\x80')).size() == 64);
+}
+
+int main()
+{
+#if defined(__AVX2__) && defined(__GNUC__)
+	if (!__builtin_cpu_supports("avx2"))
+		return TEST_SKIP;
+#endif
+
+	test_ascii();
+	test_cjk();
+	test_surrogates();
+	test_invalid_utf8();
+	return check_result();
+}